@@ -0,0 +1,209 @@
+#include "ai.h"
+
+#include <algorithm>
+
+namespace
+{
+    using TileKeys = std::array<std::array<std::uint64_t, Board::NUM_COLS>, Board::NUM_ROWS>;
+
+    TileKeys makeTileKeys()
+    {
+        // any fixed seed will do, the keys only need to look random to each other
+        Xoshiro256 rng(0x7E7215);
+        TileKeys keys;
+        for (auto& row : keys)
+        {
+            for (std::uint64_t& key : row)
+            {
+                key = rng();
+            }
+        }
+        return keys;
+    }
+
+    const TileKeys TILE_KEYS = makeTileKeys();
+
+    // keys of the tiles a piece adds when it lands without clearing anything
+    std::uint64_t hashPlacedTiles(int shape, const Placement& placement)
+    {
+        const PieceOrientation& orientation = DEFAULT_ROTATIONS[shape].orientations[placement.rotation];
+        std::uint64_t hash = 0;
+        for (PieceMask tiles = orientation.tiles; tiles != 0; tiles &= tiles - 1)
+        {
+            int bit = 0;
+            while (!((tiles >> bit) & 1))
+            {
+                bit++;
+            }
+            hash ^= TILE_KEYS[placement.row + bit / Piece::MAX_WIDTH][placement.col + bit % Piece::MAX_WIDTH];
+        }
+        return hash;
+    }
+}
+
+std::uint64_t hashStack(const StackRows& stack)
+{
+    std::uint64_t hash = 0;
+    for (int row = 0; row < Board::NUM_ROWS; row++)
+    {
+        for (int col = 0; col < Board::NUM_COLS; col++)
+        {
+            if ((stack[row] >> col) & 1)
+            {
+                hash ^= TILE_KEYS[row][col];
+            }
+        }
+    }
+    return hash;
+}
+
+BeamSearchAi::BeamSearchAi(int beamWidth, int depth)
+    : beamWidth(std::min(std::max(beamWidth, 1), MAX_BEAM_WIDTH)), depth(std::min(std::max(depth, 1), MAX_DEPTH)),
+    table(TABLE_SIZE)
+{
+    beam.reserve(MAX_BEAM_WIDTH);
+    nextBeam.reserve(MAX_BEAM_WIDTH);
+    candidates.reserve(std::size_t(MAX_BEAM_WIDTH) * MAX_PLACEMENTS);
+}
+
+bool BeamSearchAi::chooseMove(const Board& board, AiMove& move)
+{
+    const Piece* active = board.getActivePiece();
+    if (!active)
+    {
+        return false;
+    }
+
+    // the board's queue holds the next few shapes, and the generator is deterministic,
+    // so a copy of it deals exactly the pieces after those
+    std::array<int, MAX_DEPTH> queue;
+    queue[0] = active->shape;
+    PieceGenerator<Piece::NUM_DEFAULT_PIECES> generator = board.generator;
+    for (int level = 1; level < depth; level++)
+    {
+        queue[level] = level - 1 < Board::NUM_NEXT_SHAPES ? board.nextShape(level - 1) : generator.next();
+    }
+
+    nodesExpanded = 0;
+    transpositions = 0;
+    beam.clear();
+    beam.push_back(Node());
+    Node& root = beam.back();
+    root.stack = lockedStack(board);
+    root.heights = board.columnHeights;
+    root.hash = hashStack(root.stack);
+
+    bool found = false;
+    for (int level = 0; level < depth; level++)
+    {
+        // a fresh stamp empties the table for this level without touching it
+        stamp++;
+        candidates.clear();
+        int fromRow = level == 0 ? active->row : 0;
+        for (int parent = 0; parent < int(beam.size()); parent++)
+        {
+            const Node& node = beam[parent];
+            int numPlacements = evaluatePlacements(node.stack, node.heights, queue[level], fromRow, placements);
+            for (int i = 0; i < numPlacements; i++)
+            {
+                const Placement& placement = placements[i];
+                std::uint64_t hash = 0;
+                if (placement.rowsCleared == 0)
+                {
+                    hash = node.hash ^ hashPlacedTiles(queue[level], placement);
+                }
+                else
+                {
+                    // clears move every row above them, so the stack has to be hashed again
+                    StackRows stack = node.stack;
+                    applyPlacement(stack, queue[level], placement);
+                    hash = hashStack(stack);
+                }
+
+                nodesExpanded++;
+                if (seen(hash))
+                {
+                    transpositions++;
+                    continue;
+                }
+
+                Candidate candidate;
+                candidate.score = score(placement, node.rowsCleared + placement.rowsCleared);
+                candidate.parent = parent;
+                candidate.placement = placement;
+                candidate.hash = hash;
+                candidates.push_back(candidate);
+            }
+        }
+
+        if (candidates.empty())
+        {
+            // every line tops out here, so take the best line of the level before
+            break;
+        }
+
+        int keep = std::min(beamWidth, int(candidates.size()));
+        std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(), [](const Candidate& a, const Candidate& b)
+        {
+            return a.score > b.score;
+        });
+
+        nextBeam.clear();
+        for (int i = 0; i < keep; i++)
+        {
+            const Candidate& candidate = candidates[i];
+            const Node& parent = beam[candidate.parent];
+            nextBeam.push_back(parent);
+            Node& child = nextBeam.back();
+            applyPlacement(child.stack, queue[level], candidate.placement);
+            measureHeights(child.stack, child.heights);
+            child.hash = candidate.hash;
+            child.rowsCleared += candidate.placement.rowsCleared;
+            if (level == 0)
+            {
+                child.firstMove = { candidate.placement.rotation, candidate.placement.col };
+            }
+        }
+        std::swap(beam, nextBeam);
+        found = true;
+    }
+
+    if (!found)
+    {
+        return false;
+    }
+
+    // the beam is sorted best first
+    move = beam.front().firstMove;
+    return true;
+}
+
+int BeamSearchAi::score(const Placement& placement, int rowsCleared) const
+{
+    int spawnRows = std::max(0, placement.maxHeight - (Board::NUM_ROWS - Piece::MAX_HEIGHT));
+    return weights.rowsCleared * rowsCleared
+        + weights.aggregateHeight * placement.aggregateHeight
+        + weights.holes * placement.holes
+        + weights.bumpiness * placement.bumpiness
+        + weights.spawnRows * spawnRows;
+}
+
+bool BeamSearchAi::seen(std::uint64_t hash)
+{
+    std::size_t slot = std::size_t(hash >> (64 - TABLE_BITS));
+    for (int probe = 0; probe < MAX_PROBES; probe++, slot = (slot + 1) & (TABLE_SIZE - 1))
+    {
+        TableEntry& entry = table[slot];
+        if (entry.stamp != stamp)
+        {
+            entry.hash = hash;
+            entry.stamp = stamp;
+            return false;
+        }
+        if (entry.hash == hash)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+#include "placement.h"
+
+// a rotation and column to hard drop the active piece at, as Board::dropAt takes them
+struct AiMove
+{
+    int rotation = 0;
+    int col = 0;
+};
+
+// weights of the stack features a search line is scored by, higher scores are better
+struct AiWeights
+{
+    int rowsCleared = 76;
+    int aggregateHeight = -51;
+    int holes = -36;
+    int bumpiness = -18;
+    // for every row the stack reaches into the spawn area, so lines that top out lose
+    int spawnRows = -1000;
+};
+
+// plays a board by beam search over the pieces the generator deals next
+//
+// each level of the search drops one piece of the queue, the active piece first, in every
+// rotation and column onto every stack kept from the level before, and keeps the best
+// beamWidth stacks. Stacks are plain row masks with full rows cleared the naive way, the
+// cascade a real clear can cause is ignored. Identical stacks reached through different
+// move orders are found through a Zobrist hash of the row masks and expanded only once;
+// on one level they've always cleared the same number of rows, so nothing is lost.
+class BeamSearchAi
+{
+public:
+    static constexpr int MAX_BEAM_WIDTH = 64;
+    static constexpr int MAX_DEPTH = 8;
+    static constexpr int DEFAULT_BEAM_WIDTH = 16;
+    // the active piece plus the next two
+    static constexpr int DEFAULT_DEPTH = 3;
+
+    AiWeights weights;
+    // stacks reached on the last search, and how many of them were transpositions of another
+    std::uint64_t nodesExpanded = 0;
+    std::uint64_t transpositions = 0;
+
+    // the width and depth are clamped to 1 up to MAX_BEAM_WIDTH and MAX_DEPTH
+    explicit BeamSearchAi(int beamWidth = DEFAULT_BEAM_WIDTH, int depth = DEFAULT_DEPTH);
+
+    // the best place for the board's active piece, returns false if it fits nowhere
+    bool chooseMove(const Board& board, AiMove& move);
+private:
+    // one stack in the beam
+    struct Node
+    {
+        StackRows stack;
+        StackHeights heights;
+        std::uint64_t hash = 0;
+        int rowsCleared = 0;
+        // the first move of the line that led here
+        AiMove firstMove;
+    };
+
+    // a placement onto one of the beam's stacks, kept light until it makes the cut
+    struct Candidate
+    {
+        int score = 0;
+        int parent = 0;
+        Placement placement;
+        std::uint64_t hash = 0;
+    };
+
+    // open addressing over stack hashes, entries from earlier levels count as empty
+    struct TableEntry
+    {
+        std::uint64_t hash = 0;
+        std::uint32_t stamp = 0;
+    };
+
+    static constexpr int TABLE_BITS = 14;
+    static constexpr int TABLE_SIZE = 1 << TABLE_BITS;
+    // slots tried before giving up on a full neighbourhood, the stack is then just expanded again
+    static constexpr int MAX_PROBES = 8;
+
+    int beamWidth;
+    int depth;
+    std::vector<Node> beam;
+    std::vector<Node> nextBeam;
+    std::vector<Candidate> candidates;
+    std::vector<TableEntry> table;
+    std::uint32_t stamp = 0;
+    PlacementList placements;
+
+    int score(const Placement& placement, int rowsCleared) const;
+    // returns true if the hash was already seen on this level, remembering it if not
+    bool seen(std::uint64_t hash);
+};
+
+// Zobrist hash of a stack, the xor of a fixed random key for every occupied tile
+std::uint64_t hashStack(const StackRows& stack);
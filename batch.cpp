@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "ai.h"
+#include "board.h"
+#include "work_stealing.h"
+
+// plays many independent headless games across every core and sums up how they went
+
+namespace
+{
+    enum class Policy
+    {
+        // hard drops each piece at a random rotation and column
+        RANDOM,
+        // BeamSearchAi with its default width and depth
+        BEAM
+    };
+
+    // per worker so games never share a counter, merged once every worker is done
+    struct alignas(64) BatchStats
+    {
+        std::uint64_t games = 0;
+        std::uint64_t placements = 0;
+        std::uint64_t rowsCompleted = 0;
+        int maxRowsCompleted = 0;
+
+        void merge(const BatchStats& other)
+        {
+            games += other.games;
+            placements += other.placements;
+            rowsCompleted += other.rowsCompleted;
+            maxRowsCompleted = std::max(maxRowsCompleted, other.maxRowsCompleted);
+        }
+    };
+
+    void playGame(std::uint64_t seed, Policy policy, std::uint64_t maxPlacements, BeamSearchAi& ai, BatchStats& stats)
+    {
+        // the board and the policy get their own streams from the game's seed
+        Board board(seed);
+        Xoshiro256 rng(~seed);
+        bool alive = true;
+        std::uint64_t placements = 0;
+        while (alive && placements < maxPlacements)
+        {
+            switch (policy)
+            {
+            case Policy::RANDOM:
+                alive = board.dropAt(rng.below(Piece::NUM_ROTATIONS), rng.below(Board::NUM_COLS));
+                break;
+            case Policy::BEAM:
+            {
+                AiMove move;
+                alive = ai.chooseMove(board, move) && board.dropAt(move.rotation, move.col);
+                break;
+            }
+            }
+            placements += alive;
+        }
+
+        stats.games++;
+        stats.placements += placements;
+        stats.rowsCompleted += board.rowsCompleted;
+        stats.maxRowsCompleted = std::max(stats.maxRowsCompleted, board.rowsCompleted);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::uint32_t numGames = 100000;
+    int numThreads = int(std::thread::hardware_concurrency());
+    std::uint64_t seed = 1;
+    Policy policy = Policy::RANDOM;
+    // a good policy can play for as long as you let it
+    std::uint64_t maxPlacements = 100000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+        {
+            numGames = std::uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            numThreads = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--policy") == 0 && i + 1 < argc)
+        {
+            const char* name = argv[++i];
+            if (std::strcmp(name, "random") == 0)
+            {
+                policy = Policy::RANDOM;
+            }
+            else if (std::strcmp(name, "beam") == 0)
+            {
+                policy = Policy::BEAM;
+            }
+            else
+            {
+                std::fprintf(stderr, "unknown policy: %s\n", name);
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--max-placements") == 0 && i + 1 < argc)
+        {
+            maxPlacements = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--games n] [--threads n] [--seed n] [--policy random|beam] [--max-placements n]\n", argv[0]);
+            return -1;
+        }
+    }
+    numThreads = std::max(numThreads, 1);
+
+    std::vector<BatchStats> workerStats(numThreads);
+    // the search keeps its buffers between moves, so each worker reuses one
+    std::vector<BeamSearchAi> workerAis(numThreads);
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(numThreads, numGames, [&](int worker, std::uint32_t game)
+    {
+        // game n always gets the same seed, however the games were scheduled
+        playGame(seed + game, policy, maxPlacements, workerAis[worker], workerStats[worker]);
+    });
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    BatchStats total;
+    for (const BatchStats& stats : workerStats)
+    {
+        total.merge(stats);
+    }
+
+    std::printf("games:               %llu\n", (unsigned long long)total.games);
+    std::printf("threads:             %d\n", numThreads);
+    std::printf("seconds:             %.3f\n", elapsed);
+    std::printf("games/s:             %.0f\n", total.games / elapsed);
+    std::printf("placements/s:        %.0f\n", total.placements / elapsed);
+    std::printf("rows completed:      %llu\n", (unsigned long long)total.rowsCompleted);
+    std::printf("rows per game:       %.3f\n", total.games ? double(total.rowsCompleted) / total.games : 0.0);
+    std::printf("most rows in a game: %d\n", total.maxRowsCompleted);
+
+    return 0;
+}
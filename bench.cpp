@@ -0,0 +1,328 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+
+#include "ai.h"
+#include "board.h"
+#include "placement.h"
+#include "simulation.h"
+
+// microbenchmarks of the simulation hot paths, run headless on seeded fixtures
+// so numbers are comparable between builds
+
+// every heap allocation in the benchmark is counted, so it can check the game loop makes none
+std::atomic<std::uint64_t> allocationCount{ 0 };
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace
+{
+    struct Fixture
+    {
+        const char* name;
+        // stack height the fixture is filled up to before measuring
+        int height;
+        Board board;
+    };
+
+    int maxHeight(const Board& board)
+    {
+        int result = 0;
+        for (int height : board.columnHeights)
+        {
+            result = height > result ? height : result;
+        }
+        return result;
+    }
+
+    // drops pieces at random spots until the stack is tall enough, starting over if the game ends first
+    Board makeFixture(std::uint64_t seed, int height)
+    {
+        for (;; seed++)
+        {
+            Board board(seed);
+            Xoshiro256 policy(seed);
+            bool alive = true;
+            while (alive && maxHeight(board) < height)
+            {
+                alive = board.dropAt(policy.below(Piece::NUM_ROTATIONS), policy.below(Board::NUM_COLS));
+            }
+
+            if (alive)
+            {
+                return board;
+            }
+        }
+    }
+
+    // fills every gap in the bottom rows with single tiles so collapseFullRows has work to do
+    void fillBottomRows(Board& board, int numRows)
+    {
+        for (int row = Board::NUM_ROWS - numRows; row < Board::NUM_ROWS; row++)
+        {
+            for (int col = 0; col < Board::NUM_COLS; col++)
+            {
+                if (board.isOccupied(row, col))
+                {
+                    continue;
+                }
+
+                Piece tile(0, 0);
+                tile.tiles = Piece::tileBit(0, 0);
+                Piece* created = board.pieces.get(board.pieces.create(tile));
+                if (created)
+                {
+                    created->moveTo(row, col, created->tiles, board);
+                }
+            }
+        }
+    }
+
+    // runs body until at least minSeconds have passed, returns nanoseconds per call
+    double measure(double minSeconds, const std::function<void(int)>& body)
+    {
+        using Clock = std::chrono::steady_clock;
+        int iterations = 1;
+        for (;;)
+        {
+            auto start = Clock::now();
+            body(iterations);
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            if (elapsed >= minSeconds)
+            {
+                return elapsed * 1e9 / iterations;
+            }
+            iterations *= 2;
+        }
+    }
+
+    void report(const char* benchmark, const char* fixture, double nanoseconds)
+    {
+        std::printf("%-24s %-12s %12.1f ns/op\n", benchmark, fixture, nanoseconds);
+    }
+
+    // keeps results observable so the optimizer can't drop the work
+    volatile int sink = 0;
+}
+
+int main(int argc, char** argv)
+{
+    double minSeconds = 0.5;
+    std::uint64_t seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            minSeconds = 0.05;
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+    }
+
+    std::printf("placement kernel: %s\n", placementKernelName());
+
+    Fixture fixtures[] =
+    {
+        { "empty", 0, Board(seed) },
+        { "half-full", Board::NUM_ROWS / 2, makeFixture(seed, Board::NUM_ROWS / 2) },
+        { "near-death", Board::NUM_ROWS - 4, makeFixture(seed, Board::NUM_ROWS - 4) },
+    };
+
+    for (Fixture& fixture : fixtures)
+    {
+        Board board = fixture.board;
+        Piece* piece = board.getActivePiece();
+        report("Piece::moveTo", fixture.name, measure(minSeconds, [&](int iterations)
+        {
+            int moved = 0;
+            for (int i = 0; i < iterations; i++)
+            {
+                moved += piece->moveTo(piece->row, piece->col + ((i & 1) ? -1 : 1), piece->tiles, board);
+            }
+            sink = moved;
+        }));
+
+        report("Piece::rotate", fixture.name, measure(minSeconds, [&](int iterations)
+        {
+            for (int i = 0; i < iterations; i++)
+            {
+                piece->rotate(board);
+            }
+            sink = piece->rotation;
+        }));
+
+        report("Board::isRowFull", fixture.name, measure(minSeconds, [&](int iterations)
+        {
+            int full = 0;
+            for (int i = 0; i < iterations; i++)
+            {
+                full += board.isRowFull(i % Board::NUM_ROWS);
+            }
+            sink = full;
+        }));
+
+        PlacementList placements;
+        report("evaluatePlacements", fixture.name, measure(minSeconds, [&](int iterations)
+        {
+            int count = 0;
+            for (int i = 0; i < iterations; i++)
+            {
+                count += evaluatePlacements(board, i % Piece::NUM_DEFAULT_PIECES, 0, placements);
+            }
+            sink = count;
+        }));
+
+        BeamSearchAi ai;
+        report("BeamSearchAi::chooseMove", fixture.name, measure(minSeconds, [&](int iterations)
+        {
+            AiMove move;
+            for (int i = 0; i < iterations; i++)
+            {
+                ai.chooseMove(board, move);
+            }
+            sink = move.col;
+        }));
+
+        Board::State state;
+        report("Board::snapshot", fixture.name, measure(minSeconds, [&](int iterations)
+        {
+            for (int i = 0; i < iterations; i++)
+            {
+                board.snapshot(state);
+            }
+            sink = state.rowMasks[Board::NUM_ROWS - 1];
+        }));
+
+        Board restored;
+        report("Board::restore", fixture.name, measure(minSeconds, [&](int iterations)
+        {
+            for (int i = 0; i < iterations; i++)
+            {
+                restored.restore(state);
+            }
+            sink = restored.rowMasks[Board::NUM_ROWS - 1];
+        }));
+
+        // a netplay rollback: back to a saved tick, then a few dozen ticks played again, saving each one
+        constexpr int ROLLBACK_DEPTH = 32;
+        Simulation simulation;
+        simulation.board = fixture.board;
+        Simulation::State rollbackState;
+        simulation.snapshot(rollbackState);
+        std::array<Simulation::State, ROLLBACK_DEPTH> savedStates;
+        report("rollback 32 ticks", fixture.name, measure(minSeconds, [&](int iterations)
+        {
+            for (int i = 0; i < iterations; i++)
+            {
+                simulation.restore(rollbackState);
+                for (Simulation::State& saved : savedStates)
+                {
+                    simulation.snapshot(saved);
+                    simulation.step();
+                }
+            }
+            sink = int(simulation.tick);
+        }));
+
+        Board fullRows = fixture.board;
+        fillBottomRows(fullRows, 4);
+        double copyNanoseconds = measure(minSeconds, [&](int iterations)
+        {
+            for (int i = 0; i < iterations; i++)
+            {
+                Board copy = fullRows;
+                sink = copy.rowMasks[0];
+            }
+        });
+        double collapseNanoseconds = measure(minSeconds, [&](int iterations)
+        {
+            for (int i = 0; i < iterations; i++)
+            {
+                Board copy = fullRows;
+                copy.collapseFullRows();
+                sink = copy.rowMasks[0];
+            }
+        });
+        // each iteration collapses a fresh copy, so take the copy back out
+        report("Board::collapseFullRows", fixture.name, collapseNanoseconds - copyNanoseconds);
+    }
+
+    // the simulation's share of time to first frame, the game's --startup-time covers the rest
+    RenderSnapshot firstSnapshot;
+    report("first snapshot", "empty", measure(minSeconds, [&](int iterations)
+    {
+        for (int i = 0; i < iterations; i++)
+        {
+            Simulation simulation(seed + std::uint64_t(i));
+            simulation.takeSnapshot(firstSnapshot);
+            sink = firstSnapshot.activeColorIndex;
+        }
+    }));
+
+    // whole games with pieces dropped at random spots
+    using Clock = std::chrono::steady_clock;
+    long games = 0;
+    long placements = 0;
+    auto start = Clock::now();
+    double elapsed = 0;
+    for (std::uint64_t gameSeed = seed; elapsed < minSeconds * 4; gameSeed++)
+    {
+        Board board(gameSeed);
+        Xoshiro256 policy(gameSeed);
+        while (board.dropAt(policy.below(Piece::NUM_ROTATIONS), policy.below(Board::NUM_COLS)))
+        {
+            placements++;
+        }
+        games++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    std::printf("%-24s %-12s %12.0f games/s\n", "headless game", "random", games / elapsed);
+    std::printf("%-24s %-12s %12.0f placements/s\n", "headless game", "random", placements / elapsed);
+
+    // after startup, spawning, moving, locking and clearing should never touch the heap,
+    // so play on with random moves and the AI's drops, starting over whenever a game ends
+    BeamSearchAi ai;
+    Board board(seed);
+    Xoshiro256 policy(seed);
+    std::uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    const int steadyPlacements = minSeconds < 0.5 ? 2000 : 20000;
+    for (int i = 0; i < steadyPlacements; i++)
+    {
+        bool alive = board.update(Direction(policy.below(int(Direction::DROP))));
+        AiMove move;
+        alive = alive && ai.chooseMove(board, move) && board.dropAt(move.rotation, move.col);
+        if (!alive)
+        {
+            board = Board(seed + i);
+        }
+    }
+    std::uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+    std::printf("%-24s %-12s %12llu allocations\n", "steady state", "ai game", (unsigned long long)allocations);
+
+    return allocations == 0 ? 0 : 1;
+}
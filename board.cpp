@@ -0,0 +1,863 @@
+#include "board.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    // index of the lowest set bit, bits must not be 0
+    template <typename Bits>
+    int lowestBit(Bits bits)
+    {
+        // row sets of tall boards don't fit in 32 bits
+        if constexpr (sizeof(Bits) > sizeof(unsigned))
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward64(&index, bits);
+            return int(index);
+#else
+            return __builtin_ctzll(bits);
+#endif
+        }
+        else
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, bits);
+            return int(index);
+#else
+            return __builtin_ctz(bits);
+#endif
+        }
+    }
+
+    // two bits per tile packed four to a byte, as a board's State keeps them
+    template <std::size_t NumBytes>
+    int tileBits(const std::array<std::uint8_t, NumBytes>& packed, int tile)
+    {
+        return (packed[tile / 4] >> (tile % 4 * 2)) & 3;
+    }
+
+    template <std::size_t NumBytes>
+    void setTileBits(std::array<std::uint8_t, NumBytes>& packed, int tile, int bits)
+    {
+        packed[tile / 4] |= std::uint8_t(bits << (tile % 4 * 2));
+    }
+}
+
+template <typename BoardType>
+bool Piece::moveTo(int newRow, int newCol, PieceMask newTiles, BoardType& board)
+{
+    PROFILE_SCOPE(ProfileStage::PIECE_MOVE_TO);
+    // take this piece off the board first so it doesn't collide with itself
+    if (onBoard)
+    {
+        board.lift(*this);
+    }
+
+    bool result = board.fits(newTiles, newRow, newCol);
+    if (result)
+    {
+        row = newRow;
+        col = newCol;
+        tiles = newTiles;
+    }
+
+    if (result || onBoard)
+    {
+        board.place(*this);
+        onBoard = true;
+    }
+
+    return result;
+}
+
+Piece::Piece(int shape, std::uint8_t colorIndex)
+    : tiles(DEFAULT_ROTATIONS[shape].orientations[0].tiles), shape(shape), colorIndex(colorIndex)
+{
+}
+
+template <typename BoardType>
+void Piece::rotate(BoardType& board)
+{
+    int newRotation = (rotation + 1) % NUM_ROTATIONS;
+    if (moveTo(row, col, DEFAULT_ROTATIONS[shape].orientations[newRotation].tiles, board))
+    {
+        rotation = newRotation;
+    }
+}
+
+template <typename BoardType>
+bool Piece::move(Direction direction, BoardType& board)
+{
+    int newRow = row + (direction == Direction::DOWN) - (direction == Direction::UP);
+    int newCol = col + (direction == Direction::RIGHT) - (direction == Direction::LEFT);
+    return !moveTo(newRow, newCol, tiles, board) && direction == Direction::DOWN;
+}
+
+void Piece::removeRow(int rowToRemove)
+{
+    tiles &= PieceMask(~(ROW_TILES << ((rowToRemove - row) * MAX_WIDTH)));
+}
+
+template <int Rows, int Cols>
+BasicBoard<Rows, Cols>::BasicBoard(std::uint64_t seed, RandomizerMode mode) : generator(seed, mode)
+{
+    for (std::uint8_t& shape : nextShapes)
+    {
+        shape = std::uint8_t(generator.next());
+    }
+    activePiece = spawnPiece();
+}
+
+template <int Rows, int Cols>
+Piece* BasicBoard<Rows, Cols>::getActivePiece()
+{
+    return pieces.get(activePiece);
+}
+
+template <int Rows, int Cols>
+const Piece* BasicBoard<Rows, Cols>::getActivePiece() const
+{
+    return pieces.get(activePiece);
+}
+
+template <int Rows, int Cols>
+int BasicBoard<Rows, Cols>::nextShape(int index) const
+{
+    return nextShapes[(nextShapesStart + index) % NUM_NEXT_SHAPES];
+}
+
+template <int Rows, int Cols>
+PieceHandle BasicBoard<Rows, Cols>::spawnPiece()
+{
+    // the queue deals the shapes in the generator's order, it just stays a few ahead
+    std::uint8_t& shape = nextShapes[nextShapesStart];
+    Piece piece(shape, std::uint8_t(nextColorIndex));
+    shape = std::uint8_t(generator.next());
+    nextShapesStart = (nextShapesStart + 1) % NUM_NEXT_SHAPES;
+    nextColorIndex = (nextColorIndex + 1) % NUM_DEFAULT_COLORS;
+    return pieces.create(piece);
+}
+
+template <int Rows, int Cols>
+int BasicBoard<Rows, Cols>::landingRow(const Piece& piece) const
+{
+    int distance = NUM_ROWS;
+    for (int subCol = 0; subCol < Piece::MAX_WIDTH; subCol++)
+    {
+        int subRow = Piece::bottomSubRow(piece.tiles, subCol);
+        if (subRow < 0)
+        {
+            continue;
+        }
+
+        int col = piece.col + subCol;
+        int surfaceRow = NUM_ROWS - columnHeights[col];
+        int bottomRow = piece.row + subRow;
+        if (bottomRow >= surfaceRow)
+        {
+            // tucked in under an overhang, the height map says nothing about what's below
+            return piece.row + scanDropDistance(piece);
+        }
+        distance = std::min(distance, surfaceRow - bottomRow - 1);
+    }
+
+    return piece.row + distance;
+}
+
+template <int Rows, int Cols>
+bool BasicBoard<Rows, Cols>::dropAt(int rotation, int col)
+{
+    Piece* piece = getActivePiece();
+    if (!piece)
+    {
+        return false;
+    }
+
+    if (piece->moveTo(piece->row, col, DEFAULT_ROTATIONS[piece->shape].orientations[rotation].tiles, *this))
+    {
+        piece->rotation = rotation;
+    }
+    return update(Direction::DROP);
+}
+
+template <int Rows, int Cols>
+int BasicBoard<Rows, Cols>::scanDropDistance(const Piece& piece) const
+{
+    // a piece never has its own tiles below the lowest one in a column, so
+    // it doesn't need to be lifted off the board first
+    int distance = NUM_ROWS;
+    for (int subCol = 0; subCol < Piece::MAX_WIDTH; subCol++)
+    {
+        int subRow = Piece::bottomSubRow(piece.tiles, subCol);
+        if (subRow < 0)
+        {
+            continue;
+        }
+
+        int col = piece.col + subCol;
+        int firstRowBelow = piece.row + subRow + 1;
+        int row = firstRowBelow;
+        while (row < NUM_ROWS && !isOccupied(row, col) && row - firstRowBelow < distance)
+        {
+            row++;
+        }
+        distance = std::min(distance, row - firstRowBelow);
+    }
+
+    return distance;
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::lockPiece(const Piece& piece)
+{
+    for (int subCol = 0; subCol < Piece::MAX_WIDTH; subCol++)
+    {
+        for (int subRow = 0; subRow < Piece::MAX_HEIGHT; subRow++)
+        {
+            if (piece.tiles & Piece::tileBit(subRow, subCol))
+            {
+                int col = piece.col + subCol;
+                columnHeights[col] = std::max(columnHeights[col], NUM_ROWS - (piece.row + subRow));
+                break;
+            }
+        }
+    }
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::recomputeColumnHeights()
+{
+    // the first row from the top with a column's bit set is that column's surface
+    columnHeights.fill(0);
+    RowMaskType seen = 0;
+    for (int row = 0; row < NUM_ROWS && seen != FULL_ROW_MASK; row++)
+    {
+        for (RowMaskType surfaced = rowMasks[row] & ~seen; surfaced != 0; surfaced &= surfaced - 1)
+        {
+            columnHeights[lowestBit(surfaced)] = NUM_ROWS - row;
+        }
+        seen |= rowMasks[row];
+    }
+}
+
+template <int Rows, int Cols>
+bool BasicBoard<Rows, Cols>::isOccupied(int row, int col) const
+{
+    return (rowMasks[row] >> col) & 1;
+}
+
+template <int Rows, int Cols>
+bool BasicBoard<Rows, Cols>::isRowFull(int row) const
+{
+    return (fullRows >> row) & 1;
+}
+
+template <int Rows, int Cols>
+bool BasicBoard<Rows, Cols>::isAboveStack(const Piece& piece) const
+{
+    if (piece.row < 0)
+    {
+        return false;
+    }
+
+    for (int subCol = 0; subCol < Piece::MAX_WIDTH; subCol++)
+    {
+        int subRow = Piece::bottomSubRow(piece.tiles, subCol);
+        if (subRow < 0)
+        {
+            continue;
+        }
+
+        int col = piece.col + subCol;
+        if (col < 0 || col >= NUM_COLS || piece.row + subRow >= NUM_ROWS - columnHeights[col])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <int Rows, int Cols>
+bool BasicBoard<Rows, Cols>::fits(PieceMask tiles, int row, int col) const
+{
+    for (int subRow = 0; subRow < Piece::MAX_HEIGHT; subRow++)
+    {
+        unsigned bits = Piece::rowBits(tiles, subRow);
+        if (bits == 0)
+        {
+            // not an actual part of the piece so ignore
+            continue;
+        }
+
+        // where this row lands of the full board
+        int absoluteRow = row + subRow;
+        if (absoluteRow < 0 || absoluteRow >= NUM_ROWS)
+        {
+            return false;
+        }
+
+        if (col < 0)
+        {
+            if (bits & ((1u << -col) - 1))
+            {
+                // piece hangs off the left side of the board
+                return false;
+            }
+            bits >>= -col;
+        }
+        else
+        {
+            bits <<= col;
+        }
+
+        if (bits & ~unsigned(FULL_ROW_MASK))
+        {
+            // piece hangs off the right side of the board
+            return false;
+        }
+
+        if (bits & rowMasks[absoluteRow])
+        {
+            // this spot of the full board is already taken
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::place(const Piece& piece)
+{
+    for (PieceMask tiles = piece.tiles; tiles != 0; tiles &= tiles - 1)
+    {
+        int bit = lowestBit(tiles);
+        int r = piece.row + bit / Piece::MAX_WIDTH;
+        int c = piece.col + bit % Piece::MAX_WIDTH;
+        rowMasks[r] |= RowMaskType(RowMaskType(1) << c);
+        if (rowMasks[r] == FULL_ROW_MASK)
+        {
+            fullRows |= RowSetType(RowSetType(1) << r);
+        }
+        colorGrid[r][c] = piece.colorIndex;
+        ownerGrid[r][c] = piece.handle.index;
+        notifyTileChanged(r, c);
+    }
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::lift(const Piece& piece)
+{
+    for (PieceMask tiles = piece.tiles; tiles != 0; tiles &= tiles - 1)
+    {
+        int bit = lowestBit(tiles);
+        int r = piece.row + bit / Piece::MAX_WIDTH;
+        int c = piece.col + bit % Piece::MAX_WIDTH;
+        rowMasks[r] &= RowMaskType(~(RowMaskType(1) << c));
+        fullRows &= RowSetType(~(RowSetType(1) << r));
+        notifyTileChanged(r, c);
+    }
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::collapseFullRows()
+{
+    PROFILE_SCOPE(ProfileStage::COLLAPSE_FULL_ROWS);
+    if (fullRows == 0)
+    {
+        return;
+    }
+
+    // the board compacts now and doesn't wait on the animation, which works from these
+    lastClearedRows = fullRows;
+    numClears++;
+
+    // pieces settling after a clear can fill rows of their own, so keep going until none are full
+    while (fullRows != 0)
+    {
+        RowSetType clearedRows = fullRows;
+        for (RowSetType rows = clearedRows; rows != 0; rows &= rows - 1)
+        {
+            rowsCompleted++;
+        }
+
+        clearRows(clearedRows);
+        settlePieces();
+    }
+
+    recomputeColumnHeights();
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::clearRows(RowSetType clearedRows)
+{
+    // take the cleared tiles away from their owners, remembering who may have broken apart.
+    // A piece goes in once per cleared row it loses tiles in, so there's never more than a slot
+    // per cleared tile, and a settle pass can fill many more rows than one piece spans
+    std::array<std::uint16_t, NUM_ROWS * NUM_COLS> brokenSlots;
+    int numBroken = 0;
+    for (RowSetType rows = clearedRows; rows != 0; rows &= rows - 1)
+    {
+        int row = lowestBit(rows);
+        for (int col = 0; col < NUM_COLS; col++)
+        {
+            std::uint16_t slot = ownerGrid[row][col];
+            Piece* owner = pieces.getBySlot(slot);
+            if (!owner || !(owner->tiles & PieceMask(Piece::ROW_TILES << ((row - owner->row) * Piece::MAX_WIDTH))))
+            {
+                // already emptied or already stripped of this row
+                continue;
+            }
+
+            owner->removeRow(row);
+            if (owner->tiles == 0)
+            {
+                pieces.destroy(owner->handle);
+            }
+            else
+            {
+                brokenSlots[numBroken++] = slot;
+            }
+        }
+    }
+
+    int lowestFullRow = compactRows(clearedRows);
+
+    for (int i = 0; i < numBroken; i++)
+    {
+        Piece* piece = pieces.getBySlot(brokenSlots[i]);
+        if (piece)
+        {
+            splitDisconnected(*piece);
+        }
+    }
+
+    for (int row = 0; row <= lowestFullRow; row++)
+    {
+        for (int col = 0; col < NUM_COLS; col++)
+        {
+            notifyTileChanged(row, col);
+        }
+    }
+}
+
+template <int Rows, int Cols>
+int BasicBoard<Rows, Cols>::compactRows(RowSetType clearedRows)
+{
+    // shift[row] is how far a surviving row moves down, i.e. the number of full rows below it
+    std::array<int, NUM_ROWS> shift = { 0 };
+    int lowestFullRow = 0;
+    int writeRow = NUM_ROWS - 1;
+    for (int readRow = NUM_ROWS - 1; readRow >= 0; readRow--)
+    {
+        if ((clearedRows >> readRow) & 1)
+        {
+            lowestFullRow = std::max(lowestFullRow, readRow);
+            continue;
+        }
+
+        shift[readRow] = writeRow - readRow;
+        if (writeRow != readRow)
+        {
+            rowMasks[writeRow] = rowMasks[readRow];
+            colorGrid[writeRow] = colorGrid[readRow];
+            ownerGrid[writeRow] = ownerGrid[readRow];
+        }
+        writeRow--;
+    }
+
+    for (; writeRow >= 0; writeRow--)
+    {
+        rowMasks[writeRow] = 0;
+    }
+    // the full rows are gone and every row kept wasn't full
+    fullRows = 0;
+
+    // move each piece along with its rows, closing up any gap left inside it
+    for (Piece& piece : pieces)
+    {
+        if (piece.row > lowestFullRow)
+        {
+            continue;
+        }
+
+        PieceMask newTiles = 0;
+        int newRow = 0;
+        int newSubRow = -1;
+        for (int subRow = 0; subRow < Piece::MAX_HEIGHT; subRow++)
+        {
+            PieceMask bits = Piece::rowBits(piece.tiles, subRow);
+            if (bits == 0)
+            {
+                continue;
+            }
+
+            int row = piece.row + subRow;
+            if (newSubRow < 0)
+            {
+                newRow = row + shift[row];
+            }
+            newSubRow = row + shift[row] - newRow;
+            newTiles |= PieceMask(bits << (newSubRow * Piece::MAX_WIDTH));
+        }
+
+        piece.row = newRow;
+        piece.tiles = newTiles;
+    }
+
+    return lowestFullRow;
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::splitDisconnected(Piece& piece)
+{
+    constexpr PieceMask FIRST_COLUMN = 0x1111;
+    constexpr PieceMask LAST_COLUMN = 0x8888;
+
+    PieceMask remaining = piece.tiles;
+    PieceMask component = remaining & PieceMask(-remaining);
+    for (;;)
+    {
+        // grow the component by one tile in each direction, without wrapping between rows
+        PieceMask grown = component
+            | PieceMask(component << Piece::MAX_WIDTH)
+            | PieceMask(component >> Piece::MAX_WIDTH)
+            | PieceMask((component << 1) & ~FIRST_COLUMN)
+            | PieceMask((component >> 1) & ~LAST_COLUMN);
+        grown &= remaining;
+        if (grown == component)
+        {
+            break;
+        }
+        component = grown;
+    }
+
+    if (component == remaining)
+    {
+        return;
+    }
+
+    // everything not connected to the first tile becomes a piece of its own
+    Piece broken = piece;
+    broken.tiles = PieceMask(remaining & ~component);
+    piece.tiles = component;
+
+    PieceHandle handle = pieces.create(broken);
+    Piece* created = pieces.get(handle);
+    if (!created)
+    {
+        return;
+    }
+
+    for (PieceMask tiles = created->tiles; tiles != 0; tiles &= tiles - 1)
+    {
+        int bit = lowestBit(tiles);
+        ownerGrid[created->row + bit / Piece::MAX_WIDTH][created->col + bit % Piece::MAX_WIDTH] = handle.index;
+    }
+
+    // the rest may still fall apart further, e.g. a long piece cut in three
+    splitDisconnected(*created);
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::settlePieces()
+{
+    std::array<std::uint16_t, MAX_PIECES> order;
+    std::array<int, MAX_PIECES> bottoms;
+
+    bool moved = true;
+    while (moved)
+    {
+        moved = false;
+
+        // drop the lowest pieces first so what they land on has already settled
+        int numPieces = 0;
+        for (Piece& piece : pieces)
+        {
+            bottoms[piece.handle.index] = piece.row + Piece::bottomSubRow(piece.tiles);
+            order[numPieces++] = piece.handle.index;
+        }
+        std::sort(order.begin(), order.begin() + numPieces, [&bottoms](std::uint16_t a, std::uint16_t b)
+        {
+            return bottoms[a] > bottoms[b];
+        });
+
+        for (int i = 0; i < numPieces; i++)
+        {
+            Piece& piece = *pieces.getBySlot(order[i]);
+            int distance = scanDropDistance(piece);
+            if (distance > 0)
+            {
+                lift(piece);
+                piece.row += distance;
+                place(piece);
+                moved = true;
+            }
+        }
+    }
+}
+
+template <int Rows, int Cols>
+bool BasicBoard<Rows, Cols>::update(Direction direction)
+{
+    PROFILE_SCOPE(ProfileStage::BOARD_UPDATE);
+    Piece* piece = getActivePiece();
+    if (!piece)
+    {
+        return false;
+    }
+
+    bool shouldSpawn = false;
+    if (direction == Direction::UP)
+    {
+        piece->rotate(*this);
+    }
+    else if (direction == Direction::DROP)
+    {
+        piece->moveTo(landingRow(*piece), piece->col, piece->tiles, *this);
+        shouldSpawn = true;
+    }
+    else
+    {
+        shouldSpawn = piece->move(direction, *this);
+    }
+
+    if (shouldSpawn)
+    {
+        lockPiece(*piece);
+        collapseFullRows();
+        activePiece = spawnPiece();
+
+        // the height profile usually shows the spawn area is clear without looking at its tiles
+        piece = getActivePiece();
+        if (piece && isAboveStack(*piece))
+        {
+            place(*piece);
+            piece->onBoard = true;
+        }
+        else if (!piece || !piece->moveTo(piece->row, piece->col, piece->tiles, *this))
+        {
+            pieces.destroy(activePiece);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::snapshot(State& state) const
+{
+    state.rowMasks = rowMasks;
+    state.colors.fill(0);
+    state.links.fill(0);
+
+    const Piece* active = getActivePiece();
+    state.hasActivePiece = active != nullptr;
+    state.activeOnBoard = active && active->onBoard;
+    if (active)
+    {
+        state.activeTiles = active->tiles;
+        state.activeRow = std::int8_t(active->row);
+        state.activeCol = std::int8_t(active->col);
+        state.activeShape = std::uint8_t(active->shape);
+        state.activeRotation = std::uint8_t(active->rotation);
+        state.activeColorIndex = active->colorIndex;
+        if (active->onBoard)
+        {
+            for (int subRow = 0; subRow < Piece::MAX_HEIGHT; subRow++)
+            {
+                RowMaskType bits = RowMaskType(Piece::rowBits(active->tiles, subRow) << active->col);
+                if (bits != 0)
+                {
+                    state.rowMasks[active->row + subRow] &= RowMaskType(~bits);
+                }
+            }
+        }
+    }
+    else
+    {
+        state.activeTiles = 0;
+        state.activeRow = 0;
+        state.activeCol = 0;
+        state.activeShape = 0;
+        state.activeRotation = 0;
+        state.activeColorIndex = 0;
+    }
+
+    for (int row = 0; row < NUM_ROWS; row++)
+    {
+        for (RowMaskType bits = state.rowMasks[row]; bits != 0; bits &= bits - 1)
+        {
+            int col = lowestBit(bits);
+            int tile = row * NUM_COLS + col;
+            std::uint16_t owner = ownerGrid[row][col];
+            bool right = col + 1 < NUM_COLS && ((state.rowMasks[row] >> (col + 1)) & 1) && ownerGrid[row][col + 1] == owner;
+            bool below = row + 1 < NUM_ROWS && ((state.rowMasks[row + 1] >> col) & 1) && ownerGrid[row + 1][col] == owner;
+            setTileBits(state.colors, tile, colorGrid[row][col]);
+            setTileBits(state.links, tile, right | (below << 1));
+        }
+    }
+
+    state.generator = generator;
+    state.nextShapes = nextShapes;
+    state.nextShapesStart = std::uint8_t(nextShapesStart);
+    state.nextColorIndex = std::uint8_t(nextColorIndex);
+    state.rowsCompleted = rowsCompleted;
+    state.lastClearedRows = lastClearedRows;
+    state.numClears = numClears;
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::restore(const State& state)
+{
+    pieces.clear();
+    rowMasks = state.rowMasks;
+    fullRows = 0;
+
+    // every piece is one connected group of tiles, so following the links from a tile
+    // no piece has claimed yet finds the rest of its piece
+    std::array<RowMaskType, NUM_ROWS> unclaimed = rowMasks;
+    for (int row = 0; row < NUM_ROWS; row++)
+    {
+        if (rowMasks[row] == FULL_ROW_MASK)
+        {
+            fullRows |= RowSetType(RowSetType(1) << row);
+        }
+
+        while (unclaimed[row] != 0)
+        {
+            // rows are searched from the top, so this is the piece's top row
+            std::array<int, Piece::MAX_WIDTH * Piece::MAX_HEIGHT> found;
+            int numFound = 0;
+            int numVisited = 0;
+            int first = row * NUM_COLS + lowestBit(unclaimed[row]);
+            unclaimed[row] &= RowMaskType(~(RowMaskType(1) << (first % NUM_COLS)));
+            found[numFound++] = first;
+            int minCol = NUM_COLS;
+            while (numVisited < numFound)
+            {
+                int tile = found[numVisited++];
+                int r = tile / NUM_COLS;
+                int c = tile % NUM_COLS;
+                minCol = std::min(minCol, c);
+
+                int links = tileBits(state.links, tile);
+                std::array<int, 4> neighbours = { -1, -1, -1, -1 };
+                if (links & 1)
+                {
+                    neighbours[0] = tile + 1;
+                }
+                if (links & 2)
+                {
+                    neighbours[1] = tile + NUM_COLS;
+                }
+                if (c > 0 && (tileBits(state.links, tile - 1) & 1))
+                {
+                    neighbours[2] = tile - 1;
+                }
+                if (r > 0 && (tileBits(state.links, tile - NUM_COLS) & 2))
+                {
+                    neighbours[3] = tile - NUM_COLS;
+                }
+                for (int neighbour : neighbours)
+                {
+                    if (neighbour < 0 || numFound == int(found.size()))
+                    {
+                        continue;
+                    }
+                    RowMaskType bit = RowMaskType(RowMaskType(1) << (neighbour % NUM_COLS));
+                    RowMaskType& rowBits = unclaimed[neighbour / NUM_COLS];
+                    if (rowBits & bit)
+                    {
+                        rowBits &= RowMaskType(~bit);
+                        found[numFound++] = neighbour;
+                    }
+                }
+            }
+
+            Piece piece;
+            piece.row = row;
+            piece.col = minCol;
+            piece.colorIndex = std::uint8_t(tileBits(state.colors, first));
+            piece.onBoard = true;
+            for (int i = 0; i < numFound; i++)
+            {
+                piece.tiles |= Piece::tileBit(found[i] / NUM_COLS - row, found[i] % NUM_COLS - minCol);
+            }
+            PieceHandle handle = pieces.create(piece);
+            for (int i = 0; i < numFound; i++)
+            {
+                int r = found[i] / NUM_COLS;
+                int c = found[i] % NUM_COLS;
+                colorGrid[r][c] = piece.colorIndex;
+                ownerGrid[r][c] = handle.index;
+            }
+        }
+    }
+    // heights are of the locked tiles only, so they're measured before the active piece goes back
+    recomputeColumnHeights();
+
+    activePiece = PieceHandle();
+    if (state.hasActivePiece)
+    {
+        Piece piece(state.activeShape, state.activeColorIndex);
+        piece.tiles = state.activeTiles;
+        piece.rotation = state.activeRotation;
+        piece.row = state.activeRow;
+        piece.col = state.activeCol;
+        activePiece = pieces.create(piece);
+        if (state.activeOnBoard)
+        {
+            Piece& active = *getActivePiece();
+            place(active);
+            active.onBoard = true;
+        }
+    }
+
+    generator = state.generator;
+    nextShapes = state.nextShapes;
+    nextShapesStart = state.nextShapesStart;
+    nextColorIndex = state.nextColorIndex;
+    rowsCompleted = state.rowsCompleted;
+    lastClearedRows = state.lastClearedRows;
+    numClears = state.numClears;
+
+    if (observer)
+    {
+        for (int row = 0; row < NUM_ROWS; row++)
+        {
+            for (int col = 0; col < NUM_COLS; col++)
+            {
+                notifyTileChanged(row, col);
+            }
+        }
+    }
+}
+
+template <int Rows, int Cols>
+void BasicBoard<Rows, Cols>::notifyTileChanged(int row, int col)
+{
+    if (observer)
+    {
+        observer->tileChanged(*this, row, col);
+    }
+}
+
+// every board size the game is built with, each compiled with its own dimensions
+#define INSTANTIATE_BOARD(BoardType) \
+    template class BasicBoard<BoardType::NUM_ROWS, BoardType::NUM_COLS>; \
+    template void Piece::rotate(BoardType& board); \
+    template bool Piece::move(Direction direction, BoardType& board); \
+    template bool Piece::moveTo(int newRow, int newCol, PieceMask newTiles, BoardType& board);
+
+INSTANTIATE_BOARD(Board)
+INSTANTIATE_BOARD(MarathonBoard)
+INSTANTIATE_BOARD(PartyBoard)
@@ -0,0 +1,534 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+#include "generator.h"
+
+enum class Direction
+{
+    UP,
+    DOWN,
+    LEFT,
+    RIGHT,
+    // hard drop, straight to the landing row and lock
+    DROP
+};
+
+struct Color
+{
+    int red = 0;
+    int green = 0;
+    int blue = 0;
+    int alpha = 255;
+};
+constexpr Color BLACK{ 0,0,0,255 };
+constexpr Color RED{ 255,0,0,255 };
+constexpr Color GREEN{ 0,255,0,255 };
+constexpr Color BLUE{ 0,0,255,255 };
+
+constexpr Color DEFAULT_COLORS[]
+{
+    RED,
+    GREEN,
+    BLUE
+};
+constexpr int NUM_DEFAULT_COLORS = sizeof(DEFAULT_COLORS) / sizeof(Color);
+
+template <int Rows, int Cols>
+class BasicBoard;
+
+// smallest unsigned integer with at least Bits bits
+template <int Bits>
+using UintFor = std::conditional_t<(Bits <= 8), std::uint8_t,
+    std::conditional_t<(Bits <= 16), std::uint16_t,
+    std::conditional_t<(Bits <= 32), std::uint32_t, std::uint64_t>>>;
+
+// a piece's tiles packed into 16 bits, bit (subRow * 4 + subCol) is set for each tile
+using PieceMask = std::uint16_t;
+
+// refers to a piece in a PiecePool, goes stale instead of dangling once the piece is destroyed
+struct PieceHandle
+{
+    static constexpr std::uint16_t INVALID_INDEX = 0xFFFF;
+
+    std::uint16_t index = INVALID_INDEX;
+    std::uint16_t generation = 0;
+};
+
+// receives every change to the tiles on a board, e.g. to draw them
+template <int Rows, int Cols>
+class BasicBoardObserver
+{
+public:
+    virtual ~BasicBoardObserver() = default;
+
+    // the tile at (row, col) was added or removed, read the board for its new state
+    virtual void tileChanged(const BasicBoard<Rows, Cols>& board, int row, int col) = 0;
+};
+
+class Piece
+{
+public:
+    static constexpr int NUM_DEFAULT_PIECES = 5;
+    static constexpr int MAX_HEIGHT = 4;
+    static constexpr int MAX_WIDTH = 4;
+
+    using TileGridType = std::array<std::array<bool, MAX_WIDTH>, MAX_HEIGHT>;
+    static constexpr std::array<TileGridType, NUM_DEFAULT_PIECES> DEFAULT_PIECES
+    { {
+        {{
+            {1,1,1,1},
+            {0,0,0,0},
+            {0,0,0,0},
+            {0,0,0,0}
+        }},
+        {{
+            {0,1,0,0},
+            {1,1,1,0},
+            {0,0,0,0},
+            {0,0,0,0}
+        }},
+        {{
+            {1,1,0,0},
+            {1,0,0,0},
+            {1,0,0,0},
+            {0,0,0,0}
+        }},
+        {{
+            {1,1,0,0},
+            {0,1,0,0},
+            {0,1,0,0},
+            {0,0,0,0}
+        }},
+        {{
+            {1,1,0,0},
+            {1,1,0,0},
+            {0,0,0,0},
+            {0,0,0,0}
+        }}
+    }};
+
+    static constexpr int NUM_ROTATIONS = 4;
+    // all tiles in one row of a PieceMask
+    static constexpr PieceMask ROW_TILES = (1u << MAX_WIDTH) - 1;
+
+    PieceMask tiles = 0;
+    int shape = 0;
+    int rotation = 0;
+    std::uint8_t colorIndex = 0;
+    int row = 0;
+    int col = 0;
+    bool onBoard = false;
+    PieceHandle handle;
+
+    Piece() = default;
+    Piece(int shape, std::uint8_t colorIndex);
+    // pieces are the same whatever the size of the board they're on
+    template <typename BoardType>
+    void rotate(BoardType& board);
+    template <typename BoardType>
+    bool move(Direction direction, BoardType& board);
+    template <typename BoardType>
+    bool moveTo(int newRow, int newCol, PieceMask newTiles, BoardType& board);
+    // drops the tiles the piece has in a row of the board
+    void removeRow(int rowToRemove);
+
+    static constexpr PieceMask tileBit(int subRow, int subCol)
+    {
+        return PieceMask(1u << (subRow * MAX_WIDTH + subCol));
+    }
+
+    // occupancy bits of one row of a piece, bit n is column n of the piece
+    static constexpr std::uint16_t rowBits(PieceMask tiles, int subRow)
+    {
+        return (tiles >> (subRow * MAX_WIDTH)) & ROW_TILES;
+    }
+
+    // lowest subRow holding a tile, in one column or in any, -1 if there is none
+    static constexpr int bottomSubRow(PieceMask tiles, int subCol = -1)
+    {
+        for (int subRow = MAX_HEIGHT - 1; subRow >= 0; subRow--)
+        {
+            std::uint16_t bits = rowBits(tiles, subRow);
+            if (subCol < 0 ? bits != 0 : (bits >> subCol) & 1)
+            {
+                return subRow;
+            }
+        }
+        return -1;
+    }
+
+private:
+};
+
+struct PieceOrientation
+{
+    PieceMask tiles = 0;
+    // bounding box of the tiles, which always start at subRow 0 and subCol 0
+    std::uint8_t width = 0;
+    std::uint8_t height = 0;
+};
+
+struct PieceRotations
+{
+    std::array<PieceOrientation, Piece::NUM_ROTATIONS> orientations;
+    // rotations past this repeat earlier ones, e.g. 1 for a square
+    int numDistinct = 0;
+};
+
+// every clockwise rotation of a tile grid, each shifted up and left against its bounding box
+constexpr PieceRotations makeRotations(const Piece::TileGridType& tileGrid)
+{
+    PieceRotations result;
+    Piece::TileGridType grid = tileGrid;
+    for (int rotation = 0; rotation < Piece::NUM_ROTATIONS; rotation++)
+    {
+        int minRow = Piece::MAX_HEIGHT;
+        int minCol = Piece::MAX_WIDTH;
+        int maxRow = -1;
+        int maxCol = -1;
+        for (int subRow = 0; subRow < Piece::MAX_HEIGHT; subRow++)
+        {
+            for (int subCol = 0; subCol < Piece::MAX_WIDTH; subCol++)
+            {
+                if (grid[subRow][subCol])
+                {
+                    minRow = subRow < minRow ? subRow : minRow;
+                    minCol = subCol < minCol ? subCol : minCol;
+                    maxRow = subRow > maxRow ? subRow : maxRow;
+                    maxCol = subCol > maxCol ? subCol : maxCol;
+                }
+            }
+        }
+
+        PieceOrientation& orientation = result.orientations[rotation];
+        for (int subRow = minRow; subRow <= maxRow; subRow++)
+        {
+            for (int subCol = minCol; subCol <= maxCol; subCol++)
+            {
+                if (grid[subRow][subCol])
+                {
+                    orientation.tiles |= Piece::tileBit(subRow - minRow, subCol - minCol);
+                }
+            }
+        }
+        orientation.width = std::uint8_t(maxCol - minCol + 1);
+        orientation.height = std::uint8_t(maxRow - minRow + 1);
+
+        if (result.numDistinct == 0 && rotation > 0 && orientation.tiles == result.orientations[0].tiles)
+        {
+            result.numDistinct = rotation;
+        }
+
+        Piece::TileGridType rotated = { false };
+        for (int sourceRow = 0; sourceRow < Piece::MAX_HEIGHT; sourceRow++)
+        {
+            for (int sourceCol = 0; sourceCol < Piece::MAX_WIDTH; sourceCol++)
+            {
+                int destRow = sourceCol;
+                int destCol = Piece::MAX_HEIGHT - sourceRow - 1;
+                rotated[destRow][destCol] = grid[sourceRow][sourceCol];
+            }
+        }
+        grid = rotated;
+    }
+
+    if (result.numDistinct == 0)
+    {
+        result.numDistinct = Piece::NUM_ROTATIONS;
+    }
+    return result;
+}
+
+constexpr std::array<PieceRotations, Piece::NUM_DEFAULT_PIECES> makeDefaultRotations()
+{
+    std::array<PieceRotations, Piece::NUM_DEFAULT_PIECES> result;
+    for (int shape = 0; shape < Piece::NUM_DEFAULT_PIECES; shape++)
+    {
+        result[shape] = makeRotations(Piece::DEFAULT_PIECES[shape]);
+    }
+    return result;
+}
+
+// all orientations of DEFAULT_PIECES, indexed by [shape].orientations[rotation]
+constexpr std::array<PieceRotations, Piece::NUM_DEFAULT_PIECES> DEFAULT_ROTATIONS = makeDefaultRotations();
+
+// fixed capacity slot map of pieces, stored densely so they can be iterated quickly
+// and referred to by handles that stay valid while other pieces come and go
+template <int Capacity>
+class PiecePool
+{
+public:
+    PiecePool();
+
+    // returns an invalid handle when the pool is full
+    PieceHandle create(const Piece& piece);
+    void destroy(PieceHandle handle);
+    // destroys every piece, none of their handles stay valid
+    void clear();
+    // nullptr once the piece has been destroyed
+    Piece* get(PieceHandle handle);
+    const Piece* get(PieceHandle handle) const;
+    // the live piece in a slot, nullptr if the slot is free
+    Piece* getBySlot(std::uint16_t index);
+    const Piece* getBySlot(std::uint16_t index) const;
+    int size() const { return count; }
+
+    Piece* begin() { return pieces.data(); }
+    Piece* end() { return pieces.data() + count; }
+
+private:
+    static_assert(Capacity < PieceHandle::INVALID_INDEX, "slot indices must fit in a handle");
+
+    struct Slot
+    {
+        std::uint16_t generation = 0;
+        // position in pieces while the slot is live, next free slot otherwise
+        std::uint16_t next = 0;
+        bool live = false;
+    };
+
+    std::array<Piece, Capacity> pieces;
+    std::array<Slot, Capacity> slots;
+    std::uint16_t firstFree = 0;
+    int count = 0;
+};
+
+// the board is sized at compile time so every size gets collision and line clear
+// code with its own dimensions and mask types folded in
+// only the sizes instantiated at the bottom of board.cpp can be used
+template <int Rows, int Cols>
+class BasicBoard
+{
+public:
+    static constexpr int NUM_ROWS = Rows;
+    static constexpr int NUM_COLS = Cols;
+
+    // a piece row shifted into place is worked on as an unsigned, so it has to fit in one
+    static_assert(Cols + Piece::MAX_WIDTH <= 32, "a board row must fit in an unsigned with a piece hanging off it");
+    static_assert(Rows <= 64, "full rows are tracked in a 64 bit mask");
+    static_assert(Rows >= Piece::MAX_HEIGHT && Cols >= Piece::MAX_WIDTH, "a piece must fit on the board");
+
+    // bit n is column n of a row
+    using RowMaskType = UintFor<Cols>;
+    // bit n is row n of the board
+    using RowSetType = UintFor<Rows>;
+    static constexpr RowMaskType FULL_ROW_MASK = RowMaskType(RowMaskType(~RowMaskType(0)) >> (8 * sizeof(RowMaskType) - Cols));
+
+    using Observer = BasicBoardObserver<Rows, Cols>;
+
+    // bit n of a row mask is set when column n of that row is occupied
+    std::array<RowMaskType, NUM_ROWS> rowMasks = { 0 };
+    // every piece with a tile on the board has a slot, plus one being spawned
+    static constexpr int MAX_PIECES = NUM_ROWS * NUM_COLS + 1;
+
+    // index into DEFAULT_COLORS, only meaningful where the row mask bit is set
+    std::array<std::array<std::uint8_t, NUM_COLS>, NUM_ROWS> colorGrid = { 0 };
+    // pool slot of the piece owning each tile, only meaningful where the row mask bit is set
+    std::array<std::array<std::uint16_t, NUM_COLS>, NUM_ROWS> ownerGrid = { 0 };
+    // number of rows from the floor up to the highest locked tile of each column
+    std::array<int, NUM_COLS> columnHeights = { 0 };
+    // bit n is set while row n is full, kept up to date as tiles are placed and lifted
+    RowSetType fullRows = 0;
+    PiecePool<MAX_PIECES> pieces;
+    PieceHandle activePiece;
+    PieceGenerator<Piece::NUM_DEFAULT_PIECES> generator;
+    // shapes dealt ahead of time, so they can be shown and planned for, the generator
+    // is always this many pieces past the active one
+    static constexpr int NUM_NEXT_SHAPES = 5;
+    std::array<std::uint8_t, NUM_NEXT_SHAPES> nextShapes = { 0 };
+    // where the ring of next shapes starts
+    int nextShapesStart = 0;
+    int rowsCompleted = 0;
+    // the rows the latest clear took out, numbered as they were before it, and a count of clears,
+    // so a front end can animate a clear after the board has already moved past it. Only a clear's
+    // first pass is kept, not rows that pieces settling afterwards filled
+    RowSetType lastClearedRows = 0;
+    std::uint32_t numClears = 0;
+
+    // optional, a headless board runs without one
+    Observer* observer = nullptr;
+
+    // everything a game goes on from, trivially copyable and a few hundred bytes rather
+    // than the tens of kilobytes of the board itself, so search and rollback can save and
+    // load boards as often as they like. Which tiles belong to which piece is kept as links
+    // between neighbouring tiles, so restoring rebuilds the same pieces and line clears
+    // cascade just like they would have
+    struct State
+    {
+        static constexpr int NUM_TILE_BYTES = (NUM_ROWS * NUM_COLS * 2 + 7) / 8;
+
+        // the locked tiles, without the active piece
+        std::array<RowMaskType, NUM_ROWS> rowMasks;
+        // two bits per tile, row by row: its color index
+        std::array<std::uint8_t, NUM_TILE_BYTES> colors;
+        // two bits per tile: whether the tile to its right, and the one below it, are of the same piece
+        std::array<std::uint8_t, NUM_TILE_BYTES> links;
+        PieceGenerator<Piece::NUM_DEFAULT_PIECES> generator;
+        std::array<std::uint8_t, NUM_NEXT_SHAPES> nextShapes;
+        std::uint8_t nextShapesStart;
+        std::uint8_t nextColorIndex;
+        std::int32_t rowsCompleted;
+        // kept so a board played forward again after a rollback doesn't count its clears twice
+        RowSetType lastClearedRows;
+        std::uint32_t numClears;
+
+        PieceMask activeTiles;
+        std::int8_t activeRow;
+        std::int8_t activeCol;
+        std::uint8_t activeShape;
+        std::uint8_t activeRotation;
+        std::uint8_t activeColorIndex;
+        // a board has no active piece once the game is over, and a spawned one isn't on the board until it first moves
+        bool hasActivePiece;
+        bool activeOnBoard;
+    };
+    static_assert(std::is_trivially_copyable<State>::value, "a state must copy as plain bytes");
+    static_assert(NUM_DEFAULT_COLORS <= 4, "a tile's color index must fit in two bits");
+
+    explicit BasicBoard(std::uint64_t seed = 0, RandomizerMode mode = RandomizerMode::BAG);
+    // nullptr once the game is over
+    Piece* getActivePiece();
+    const Piece* getActivePiece() const;
+    // the shape that spawns index pieces after the active one, 0 is the next piece
+    int nextShape(int index) const;
+    PieceHandle spawnPiece();
+    // row a piece would come to rest at if dropped straight down from where it is
+    int landingRow(const Piece& piece) const;
+    // for bots, turns the active piece to a rotation and column in one step if it fits there, then hard drops it
+    bool dropAt(int rotation, int col);
+    bool isOccupied(int row, int col) const;
+    bool isRowFull(int row) const;
+    // whether every tile of a piece is above the locked stack, which means it fits without checking tiles
+    bool isAboveStack(const Piece& piece) const;
+    bool fits(PieceMask tiles, int row, int col) const;
+    void place(const Piece& piece);
+    void lift(const Piece& piece);
+    void collapseFullRows();
+    bool update(Direction direction);
+    void snapshot(State& state) const;
+    // the pieces come back in new pool slots, so handles from before are no longer valid
+    void restore(const State& state);
+private:
+    int nextColorIndex = 0;
+
+    // how far a piece can fall before one of its columns hits a tile or the floor
+    int scanDropDistance(const Piece& piece) const;
+    void lockPiece(const Piece& piece);
+    void recomputeColumnHeights();
+    // strips the full rows from their pieces and closes up the gaps they leave
+    void clearRows(RowSetType clearedRows);
+    // moves every row that isn't full down over the full ones in one pass, returns the lowest full row
+    int compactRows(RowSetType clearedRows);
+    // gives each group of connected tiles of a piece its own piece
+    void splitDisconnected(Piece& piece);
+    // drops every piece that lost its support until it rests on something again
+    void settlePieces();
+    void notifyTileChanged(int row, int col);
+};
+
+// the classic board
+using Board = BasicBoard<20, 12>;
+using BoardObserver = Board::Observer;
+// 10 wide and 40 tall, for marathon games
+using MarathonBoard = BasicBoard<40, 10>;
+// 16 wide and 24 tall, for party games
+using PartyBoard = BasicBoard<24, 16>;
+
+template <int Capacity>
+PiecePool<Capacity>::PiecePool()
+{
+    for (int index = 0; index < Capacity; index++)
+    {
+        slots[index].next = std::uint16_t(index + 1);
+    }
+}
+
+template <int Capacity>
+PieceHandle PiecePool<Capacity>::create(const Piece& piece)
+{
+    if (count == Capacity)
+    {
+        return PieceHandle();
+    }
+
+    std::uint16_t index = firstFree;
+    Slot& slot = slots[index];
+    firstFree = slot.next;
+    slot.next = std::uint16_t(count);
+    slot.live = true;
+
+    Piece& created = pieces[count++];
+    created = piece;
+    created.handle = { index, slot.generation };
+    return created.handle;
+}
+
+template <int Capacity>
+void PiecePool<Capacity>::destroy(PieceHandle handle)
+{
+    Piece* piece = get(handle);
+    if (!piece)
+    {
+        return;
+    }
+
+    // fill the hole with the last piece so the live pieces stay contiguous
+    Slot& slot = slots[handle.index];
+    Piece& last = pieces[--count];
+    if (piece != &last)
+    {
+        *piece = last;
+        slots[last.handle.index].next = slot.next;
+    }
+
+    slot.generation++;
+    slot.live = false;
+    slot.next = firstFree;
+    firstFree = handle.index;
+}
+
+template <int Capacity>
+void PiecePool<Capacity>::clear()
+{
+    for (int i = 0; i < count; i++)
+    {
+        std::uint16_t index = pieces[i].handle.index;
+        Slot& slot = slots[index];
+        slot.generation++;
+        slot.live = false;
+        slot.next = firstFree;
+        firstFree = index;
+    }
+    count = 0;
+}
+
+template <int Capacity>
+Piece* PiecePool<Capacity>::get(PieceHandle handle)
+{
+    return const_cast<Piece*>(static_cast<const PiecePool&>(*this).get(handle));
+}
+
+template <int Capacity>
+const Piece* PiecePool<Capacity>::get(PieceHandle handle) const
+{
+    if (handle.index >= Capacity || slots[handle.index].generation != handle.generation)
+    {
+        return nullptr;
+    }
+    return getBySlot(handle.index);
+}
+
+template <int Capacity>
+Piece* PiecePool<Capacity>::getBySlot(std::uint16_t index)
+{
+    return const_cast<Piece*>(static_cast<const PiecePool&>(*this).getBySlot(index));
+}
+
+template <int Capacity>
+const Piece* PiecePool<Capacity>::getBySlot(std::uint16_t index) const
+{
+    return slots[index].live ? &pieces[slots[index].next] : nullptr;
+}
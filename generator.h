@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// xoshiro256** by Blackman and Vigna, small, fast and plenty random for dealing pieces
+class Xoshiro256
+{
+public:
+    using result_type = std::uint64_t;
+
+    std::array<std::uint64_t, 4> state = { 0 };
+
+    explicit Xoshiro256(std::uint64_t seed = 0)
+    {
+        // expand the seed with splitmix64 so similar seeds give unrelated streams
+        for (std::uint64_t& word : state)
+        {
+            seed += 0x9E3779B97F4A7C15ull;
+            std::uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~result_type(0); }
+
+    result_type operator()()
+    {
+        std::uint64_t result = rotl(state[1] * 5, 7) * 9;
+        std::uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // uniform in [0, bound) without a division, bound must be small
+    std::uint32_t below(std::uint32_t bound)
+    {
+        return std::uint32_t(((*this)() >> 32) * bound >> 32);
+    }
+
+private:
+    static constexpr std::uint64_t rotl(std::uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+enum class RandomizerMode
+{
+    // every shape equally likely every time
+    UNIFORM,
+    // every shape once per bag, in shuffled order
+    BAG
+};
+
+// deals the sequence of piece shapes for one game, the same seed always deals the same sequence
+template <int NumShapes>
+class PieceGenerator
+{
+public:
+    Xoshiro256 rng;
+    RandomizerMode mode = RandomizerMode::BAG;
+    std::array<std::uint8_t, NumShapes> bag = { 0 };
+    int bagRemaining = 0;
+
+    explicit PieceGenerator(std::uint64_t seed = 0, RandomizerMode mode = RandomizerMode::BAG)
+        : rng(seed), mode(mode)
+    {
+    }
+
+    int next()
+    {
+        if (mode == RandomizerMode::UNIFORM)
+        {
+            return int(rng.below(NumShapes));
+        }
+
+        if (bagRemaining == 0)
+        {
+            for (int shape = 0; shape < NumShapes; shape++)
+            {
+                bag[shape] = std::uint8_t(shape);
+            }
+            bagRemaining = NumShapes;
+        }
+
+        // draw one of the shapes left in the bag and swap it out of the way
+        int index = int(rng.below(std::uint32_t(bagRemaining)));
+        std::uint8_t shape = bag[index];
+        bag[index] = bag[--bagRemaining];
+        bag[bagRemaining] = shape;
+        return shape;
+    }
+};
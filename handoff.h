@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// lock-free ways for exactly one producer thread to hand data to exactly one consumer thread
+
+// the producer always has a buffer to write and the consumer always has one to read,
+// the third sits between them holding the newest published value, so neither side
+// ever waits on the other and the consumer skips straight to the latest value
+template <typename T>
+class TripleBuffer
+{
+public:
+    // producer side, the buffer to fill before publishing
+    T& writeBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    // producer side, makes the write buffer the newest value
+    void publish()
+    {
+        std::uint8_t previous = middle.exchange(std::uint8_t(writeIndex | FRESH), std::memory_order_acq_rel);
+        writeIndex = previous & INDEX_MASK;
+    }
+
+    // consumer side, takes the newest value if one was published since the last call
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return false;
+        }
+
+        std::uint8_t previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    // consumer side, the value taken by the last successful update
+    const T& readBuffer() const
+    {
+        return buffers[readIndex];
+    }
+private:
+    static constexpr std::uint8_t INDEX_MASK = 0x3;
+    // set in middle when it holds a value the consumer hasn't taken yet
+    static constexpr std::uint8_t FRESH = 0x4;
+
+    std::array<T, 3> buffers = {};
+    // only touched by the producer
+    alignas(64) std::uint8_t writeIndex = 0;
+    alignas(64) std::atomic<std::uint8_t> middle{ 1 };
+    // only touched by the consumer
+    alignas(64) std::uint8_t readIndex = 2;
+};
+
+// a bounded ring of values, Capacity must be a power of two
+template <typename T, int Capacity>
+class SpscQueue
+{
+public:
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    // producer side, returns false if the queue is full
+    bool push(const T& value)
+    {
+        std::uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - head.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+
+        values[tail & (Capacity - 1)] = value;
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns false if the queue is empty
+    bool pop(T& value)
+    {
+        std::uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (head == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        value = values[head & (Capacity - 1)];
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool empty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+private:
+    std::array<T, Capacity> values = {};
+    alignas(64) std::atomic<std::uint32_t> head{ 0 };
+    alignas(64) std::atomic<std::uint32_t> tail{ 0 };
+};
@@ -0,0 +1,129 @@
+#include "input.h"
+
+#include <algorithm>
+
+namespace
+{
+    // rotations and shifts go before drops, so a tap of each on one tick drops the moved piece
+    constexpr std::array<Direction, InputHandler::NUM_KEYS> POLL_ORDER =
+    {
+        Direction::UP, Direction::LEFT, Direction::RIGHT, Direction::DOWN, Direction::DROP
+    };
+}
+
+void InputHandler::press(Direction direction)
+{
+    Key& key = keys[int(direction)];
+    if (key.held)
+    {
+        return;
+    }
+
+    key.held = true;
+    key.presses = std::min(key.presses + 1, MAX_PRESSES_PER_KEY);
+    if (isShift(direction))
+    {
+        shiftDirection = direction;
+    }
+}
+
+void InputHandler::release(Direction direction)
+{
+    Key& key = keys[int(direction)];
+    key.held = false;
+    key.nextRepeat = NEVER;
+
+    if (isShift(direction) && shiftDirection == direction)
+    {
+        // the other side takes over if it's still held, starting its delay again
+        Direction other = direction == Direction::LEFT ? Direction::RIGHT : Direction::LEFT;
+        if (keys[int(other)].held)
+        {
+            shiftDirection = other;
+            keys[int(other)].nextRepeat = lastTick + repeatDelay(other);
+        }
+    }
+}
+
+void InputHandler::releaseAll()
+{
+    for (Key& key : keys)
+    {
+        key.held = false;
+        key.nextRepeat = NEVER;
+    }
+}
+
+int InputHandler::poll(std::uint64_t tick, Inputs& inputs)
+{
+    lastTick = tick;
+    int numInputs = 0;
+    for (Direction direction : POLL_ORDER)
+    {
+        Key& key = keys[int(direction)];
+        if (key.presses > 0)
+        {
+            for (; key.presses > 0; key.presses--)
+            {
+                inputs[numInputs++] = direction;
+            }
+            if (key.held && repeatInterval(direction) > 0)
+            {
+                key.nextRepeat = tick + repeatDelay(direction);
+            }
+            continue;
+        }
+
+        bool repeats = key.held && (!isShift(direction) || direction == shiftDirection);
+        if (repeats && tick >= key.nextRepeat)
+        {
+            inputs[numInputs++] = direction;
+            key.nextRepeat = tick + repeatInterval(direction);
+        }
+    }
+    return numInputs;
+}
+
+std::uint64_t InputHandler::nextRepeatTick() const
+{
+    std::uint64_t next = NEVER;
+    for (int i = 0; i < NUM_KEYS; i++)
+    {
+        const Key& key = keys[i];
+        if (key.presses > 0)
+        {
+            return lastTick;
+        }
+        if (key.held && (!isShift(Direction(i)) || Direction(i) == shiftDirection))
+        {
+            next = std::min(next, key.nextRepeat);
+        }
+    }
+    return next;
+}
+
+int InputHandler::repeatDelay(Direction direction)
+{
+    return isShift(direction) ? DAS_TICKS : repeatInterval(direction);
+}
+
+int InputHandler::repeatInterval(Direction direction)
+{
+    switch (direction)
+    {
+    case Direction::LEFT:
+    case Direction::RIGHT:
+        return ARR_TICKS;
+    case Direction::DOWN:
+        return SOFT_DROP_TICKS;
+    case Direction::UP:
+    case Direction::DROP:
+        break;
+    }
+    return 0;
+}
+
+bool InputHandler::isShift(Direction direction)
+{
+    return direction == Direction::LEFT || direction == Direction::RIGHT;
+}
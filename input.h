@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "board.h"
+#include "simulation.h"
+
+// turns key presses and releases into board inputs on simulation ticks
+//
+// the front end drains every pending event into press and release, ignoring the OS's
+// own key repeat, then calls poll once per tick as it steps the simulation. A press
+// moves the piece on the next tick polled, however many events came with it, and
+// holding a key repeats it on ticks rather than whenever the OS sends a repeat:
+// left and right after a delayed auto-shift, soft drop straight away
+class InputHandler
+{
+public:
+    // ticks a side key is held before it repeats, and between repeats, about 167ms and 33ms
+    static constexpr int DAS_TICKS = Simulation::TICKS_PER_SECOND / 6;
+    static constexpr int ARR_TICKS = Simulation::TICKS_PER_SECOND / 30;
+    // ticks between rows while soft drop is held, 40 rows a second
+    static constexpr int SOFT_DROP_TICKS = Simulation::TICKS_PER_SECOND / 40;
+    // presses of one key between two ticks that still count separately, e.g. after a stall
+    static constexpr int MAX_PRESSES_PER_KEY = 4;
+    static constexpr int NUM_KEYS = int(Direction::DROP) + 1;
+    static constexpr int MAX_INPUTS_PER_TICK = NUM_KEYS * MAX_PRESSES_PER_KEY;
+    static constexpr std::uint64_t NEVER = ~std::uint64_t(0);
+
+    using Inputs = std::array<Direction, MAX_INPUTS_PER_TICK>;
+
+    // pressing a key that's already held does nothing, so OS repeats coalesce away
+    void press(Direction direction);
+    void release(Direction direction);
+    // lets go of everything, e.g. when the window loses focus and releases would go missing
+    void releaseAll();
+
+    // the inputs due on this tick, in the order they should be applied, returns how many.
+    // polling the same tick again only returns presses that arrived in between
+    int poll(std::uint64_t tick, Inputs& inputs);
+    // the next tick a held key repeats on, or NEVER
+    std::uint64_t nextRepeatTick() const;
+private:
+    struct Key
+    {
+        bool held = false;
+        // presses not yet polled
+        int presses = 0;
+        std::uint64_t nextRepeat = NEVER;
+    };
+
+    std::array<Key, NUM_KEYS> keys;
+    // left and right share one shift, the most recently pressed side wins
+    Direction shiftDirection = Direction::LEFT;
+    std::uint64_t lastTick = 0;
+
+    static int repeatDelay(Direction direction);
+    static int repeatInterval(Direction direction);
+    static bool isShift(Direction direction);
+};
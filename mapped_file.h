@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// a read-only file mapped into memory, for blobs like atlases that are used as they are
+// on disk, so loading one is a page fault for each page touched rather than a read and a copy
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    // returns false if the file can't be opened or mapped, an empty file can't be
+    bool open(const char* path);
+    bool isOpen() const { return mapped != nullptr; }
+    const std::uint8_t* data() const { return mapped; }
+    std::size_t size() const { return mappedSize; }
+    void close();
+private:
+    const std::uint8_t* mapped = nullptr;
+    std::size_t mappedSize = 0;
+};
@@ -0,0 +1,544 @@
+#include "match_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    // the most batches one wakeup takes in, so a flood can't hold up the passes
+    constexpr int MAX_RECEIVE_BATCHES = 16;
+    // asked of the kernel for each of the shard's socket queues, a pass's packets go out at once
+    constexpr int SOCKET_BUFFER_SIZE = 4 << 20;
+    // a match's packets keep going out this long after it's over, as long as a client waits on a peer
+    constexpr auto OVER_LINGER = NetplaySession::TIMEOUT;
+
+    // what NetplaySession::connect sends until it hears back
+    bool isHello(const NetPacket& packet)
+    {
+        return packet.firstSequence == 0 && packet.numInputs == 0 && packet.ack == 0 && packet.tick == 0 && !packet.finished;
+    }
+}
+
+static_assert(sizeof(sockaddr_in6) <= sizeof(ClientAddress::bytes), "an IPv6 address must fit in ClientAddress");
+
+struct MatchShard::IoBuffers
+{
+    std::array<std::array<std::uint8_t, NetPacket::MAX_SIZE>, BATCH_SIZE> receiveData;
+    std::array<sockaddr_storage, BATCH_SIZE> receiveAddresses;
+    std::array<iovec, BATCH_SIZE> receiveVectors;
+    std::array<mmsghdr, BATCH_SIZE> receiveHeaders;
+
+    std::array<std::array<std::uint8_t, NetPacket::MAX_SIZE>, BATCH_SIZE> sendData;
+    std::array<iovec, BATCH_SIZE> sendVectors;
+    std::array<mmsghdr, BATCH_SIZE> sendHeaders;
+
+    // built once and reused, a NetPacket is too big to want on the stack for every datagram
+    NetPacket packet;
+
+    IoBuffers()
+    {
+        std::memset(receiveHeaders.data(), 0, sizeof(receiveHeaders));
+        std::memset(sendHeaders.data(), 0, sizeof(sendHeaders));
+        for (int i = 0; i < BATCH_SIZE; i++)
+        {
+            receiveVectors[i] = { receiveData[i].data(), receiveData[i].size() };
+            receiveHeaders[i].msg_hdr.msg_iov = &receiveVectors[i];
+            receiveHeaders[i].msg_hdr.msg_iovlen = 1;
+            receiveHeaders[i].msg_hdr.msg_name = &receiveAddresses[i];
+
+            sendVectors[i] = { sendData[i].data(), 0 };
+            sendHeaders[i].msg_hdr.msg_iov = &sendVectors[i];
+            sendHeaders[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+};
+
+MatchShard::MatchShard(int maxMatches)
+    : maxMatches(std::max(maxMatches, 1)), io(new IoBuffers())
+{
+    int numPlayers = this->maxMatches * 2;
+    matchStates.assign(this->maxMatches, MatchState::FREE);
+    matchSeeds.assign(this->maxMatches, 0);
+    matchStartLevels.assign(this->maxMatches, Simulation::MIN_LEVEL);
+    matchOverTimes.assign(this->maxMatches, Clock::time_point());
+    freeMatches.reserve(this->maxMatches);
+    // handed out lowest first, so a quiet shard keeps to the front of the arrays
+    for (int match = this->maxMatches - 1; match >= 0; match--)
+    {
+        freeMatches.push_back(match);
+    }
+
+    addresses.resize(numPlayers);
+    lastHeard.assign(numPlayers, Clock::time_point());
+    received.assign(numPlayers, 0);
+    relayed.assign(numPlayers, 0);
+    applied.assign(numPlayers, 0);
+    confirmedTicks.assign(numPlayers, 0);
+    finished.assign(numPlayers, 0);
+    sendDue.assign(numPlayers, 0);
+    duePlayers.reserve(numPlayers);
+    inputs.resize(numPlayers);
+    simulations.resize(numPlayers);
+    std::size_t numSlots = 1;
+    while (numSlots < std::size_t(numPlayers) * 2)
+    {
+        numSlots *= 2;
+    }
+    playerSlots.assign(numSlots, -1);
+    slotMask = numSlots - 1;
+}
+
+MatchShard::~MatchShard()
+{
+    if (epollHandle >= 0)
+    {
+        ::close(epollHandle);
+    }
+    if (socketHandle >= 0)
+    {
+        ::close(socketHandle);
+    }
+}
+
+bool MatchShard::open(int port)
+{
+    // one socket takes both, IPv4 clients show up as mapped IPv6 addresses
+    socketHandle = ::socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (socketHandle < 0)
+    {
+        return false;
+    }
+    int on = 1;
+    int off = 0;
+    int bufferSize = SOCKET_BUFFER_SIZE;
+    // every shard binds the same port, the kernel picks one per client address
+    if (::setsockopt(socketHandle, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0
+        || ::setsockopt(socketHandle, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) != 0)
+    {
+        return false;
+    }
+    // the kernel caps these as it likes, smaller queues only mean more drops under load
+    ::setsockopt(socketHandle, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    ::setsockopt(socketHandle, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+    sockaddr_in6 address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_port = htons(std::uint16_t(port));
+    address.sin6_addr = in6addr_any;
+    if (::bind(socketHandle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        return false;
+    }
+
+    epollHandle = ::epoll_create1(0);
+    if (epollHandle < 0)
+    {
+        return false;
+    }
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = socketHandle;
+    return ::epoll_ctl(epollHandle, EPOLL_CTL_ADD, socketHandle, &event) == 0;
+}
+
+bool MatchShard::run(const std::atomic<bool>& running)
+{
+    epoll_event event;
+    auto nextPass = Clock::now();
+    while (running.load(std::memory_order_relaxed))
+    {
+        auto now = Clock::now();
+        if (now >= nextPass)
+        {
+            pass(now);
+            // a late pass doesn't make the next ones come sooner to catch up
+            nextPass = std::max(nextPass + TICK_INTERVAL, now);
+        }
+
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(nextPass - Clock::now()).count() + 1;
+        int numEvents = ::epoll_wait(epollHandle, &event, 1, int(std::max<long long>(timeout, 0)));
+        if (numEvents < 0 && errno != EINTR)
+        {
+            return false;
+        }
+        if (numEvents > 0)
+        {
+            receiveAll(Clock::now());
+        }
+    }
+    return true;
+}
+
+void MatchShard::receiveAll(Clock::time_point now)
+{
+    for (int batch = 0; batch < MAX_RECEIVE_BATCHES; batch++)
+    {
+        for (mmsghdr& header : io->receiveHeaders)
+        {
+            header.msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        }
+        int count = ::recvmmsg(socketHandle, io->receiveHeaders.data(), BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        if (count <= 0)
+        {
+            break;
+        }
+        stats.packetsReceived.fetch_add(std::uint64_t(count), std::memory_order_relaxed);
+
+        for (int i = 0; i < count; i++)
+        {
+            const mmsghdr& header = io->receiveHeaders[i];
+            if (header.msg_hdr.msg_namelen > sizeof(ClientAddress::bytes))
+            {
+                continue;
+            }
+            ClientAddress from;
+            from.size = header.msg_hdr.msg_namelen;
+            std::memcpy(from.bytes.data(), &io->receiveAddresses[i], from.size);
+            if (io->packet.read(io->receiveData[i].data(), int(header.msg_len)))
+            {
+                handlePacket(from, io->packet, now);
+            }
+        }
+
+        if (count < BATCH_SIZE)
+        {
+            break;
+        }
+    }
+
+    // inputs go on to the opponent now rather than at the next pass, so relaying them adds as
+    // little to the round trip as it can
+    for (int player : duePlayers)
+    {
+        // unless a pass got to it first
+        if (sendDue[player])
+        {
+            queuePacket(player);
+        }
+    }
+    duePlayers.clear();
+    flushPackets();
+}
+
+void MatchShard::handlePacket(const ClientAddress& from, const NetPacket& packet, Clock::time_point now)
+{
+    int player = findPlayer(from);
+    if (player < 0)
+    {
+        if (isHello(packet))
+        {
+            handleHello(from, packet, now);
+        }
+        return;
+    }
+
+    int opponent = player ^ 1;
+    int match = player / 2;
+    lastHeard[player] = now;
+    if (matchStates[match] == MatchState::WAITING)
+    {
+        return;
+    }
+    if (packet.seed != matchSeeds[match] || packet.startLevel != matchStartLevels[match])
+    {
+        // hellos from before the player heard which seed the match is on
+        return;
+    }
+
+    // what the player has of its opponent's inputs doesn't need relaying again
+    if (packet.ack > relayed[opponent] && packet.ack <= received[opponent])
+    {
+        relayed[opponent] = packet.ack;
+    }
+
+    // the same checks NetplaySession makes of its peer
+    if (packet.firstSequence > received[player])
+    {
+        return;
+    }
+    int skip = int(std::min<std::uint64_t>(received[player] - packet.firstSequence, std::uint64_t(packet.numInputs)));
+    for (int i = skip; i < packet.numInputs; i++)
+    {
+        if (packet.inputs[i].tick < confirmedTicks[player])
+        {
+            return;
+        }
+    }
+
+    // inputs that don't fit go unacknowledged, so the player sends them again once there's room
+    std::uint64_t oldest = std::min(applied[player], relayed[player]);
+    int taken = skip;
+    for (; taken < packet.numInputs && received[player] - oldest < MAX_BUFFERED_INPUTS; taken++)
+    {
+        inputs[player][received[player] % MAX_BUFFERED_INPUTS] = packet.inputs[taken];
+        received[player]++;
+    }
+
+    if (taken == packet.numInputs)
+    {
+        confirmedTicks[player] = std::max(confirmedTicks[player], packet.tick);
+        finished[player] = finished[player] || packet.finished;
+    }
+    else
+    {
+        // only the ticks before the first input left out are known to be complete
+        confirmedTicks[player] = std::max(confirmedTicks[player], packet.inputs[taken].tick);
+    }
+
+    if (taken > skip && !sendDue[opponent])
+    {
+        sendDue[opponent] = 1;
+        duePlayers.push_back(opponent);
+    }
+}
+
+void MatchShard::handleHello(const ClientAddress& from, const NetPacket& packet, Clock::time_point now)
+{
+    // the pass may not have got to a waiting player that's gone quiet yet
+    if (waitingMatch >= 0 && now - lastHeard[waitingMatch * 2] > WAITING_TIMEOUT)
+    {
+        freeMatch(waitingMatch);
+    }
+
+    if (waitingMatch < 0)
+    {
+        if (freeMatches.empty())
+        {
+            // the client keeps saying hello, and gets a match if one frees up before it gives up
+            return;
+        }
+        int match = freeMatches.back();
+        freeMatches.pop_back();
+        matchStates[match] = MatchState::WAITING;
+        matchSeeds[match] = packet.seed;
+        matchStartLevels[match] = packet.startLevel;
+        addresses[match * 2] = from;
+        lastHeard[match * 2] = now;
+        addPlayer(match * 2);
+        // nothing goes back until there's an opponent, as connect starts playing on the first reply
+        waitingMatch = match;
+        return;
+    }
+
+    int match = waitingMatch;
+    waitingMatch = -1;
+    // the lower of the two, as two clients playing each other directly would pick
+    if (packet.seed < matchSeeds[match] || (packet.seed == matchSeeds[match] && packet.startLevel < matchStartLevels[match]))
+    {
+        matchSeeds[match] = packet.seed;
+        matchStartLevels[match] = packet.startLevel;
+    }
+    addresses[match * 2 + 1] = from;
+    lastHeard[match * 2 + 1] = now;
+    addPlayer(match * 2 + 1);
+
+    for (int player = match * 2; player <= match * 2 + 1; player++)
+    {
+        received[player] = 0;
+        relayed[player] = 0;
+        applied[player] = 0;
+        confirmedTicks[player] = 0;
+        finished[player] = 0;
+        simulations[player] = Simulation(matchSeeds[match], RandomizerMode::BAG, matchStartLevels[match]);
+        // the reply tells both which seed they're on
+        if (!sendDue[player])
+        {
+            sendDue[player] = 1;
+            duePlayers.push_back(player);
+        }
+    }
+    matchStates[match] = MatchState::PLAYING;
+    stats.activeMatches.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MatchShard::pass(Clock::time_point now)
+{
+    for (int match = 0; match < maxMatches; match++)
+    {
+        int first = match * 2;
+        int second = first + 1;
+        switch (matchStates[match])
+        {
+        case MatchState::FREE:
+            continue;
+        case MatchState::WAITING:
+            if (now - lastHeard[first] > WAITING_TIMEOUT)
+            {
+                freeMatch(match);
+            }
+            continue;
+        case MatchState::PLAYING:
+            if (now - lastHeard[first] > NetplaySession::TIMEOUT || now - lastHeard[second] > NetplaySession::TIMEOUT)
+            {
+                stats.abandonedMatches.fetch_add(1, std::memory_order_relaxed);
+                freeMatch(match);
+                continue;
+            }
+            playInputs(first);
+            playInputs(second);
+            if (finished[first] && finished[second] && simulations[first].gameOver && simulations[second].gameOver)
+            {
+                // whoever stays up longer wins and rows break a tie, as the clients decide it
+                const Simulation& a = simulations[first];
+                const Simulation& b = simulations[second];
+                if (a.tick == b.tick && a.board.rowsCompleted == b.board.rowsCompleted)
+                {
+                    stats.drawnMatches.fetch_add(1, std::memory_order_relaxed);
+                }
+                stats.finishedMatches.fetch_add(1, std::memory_order_relaxed);
+                matchStates[match] = MatchState::OVER;
+                matchOverTimes[match] = now;
+            }
+            break;
+        case MatchState::OVER:
+            if (now - matchOverTimes[match] >= OVER_LINGER)
+            {
+                freeMatch(match);
+                continue;
+            }
+            break;
+        }
+
+        queuePacket(first);
+        queuePacket(second);
+    }
+    flushPackets();
+}
+
+void MatchShard::playInputs(int player)
+{
+    Simulation& simulation = simulations[player];
+    const auto& ring = inputs[player];
+    int ticks = 0;
+    for (; ticks < MAX_TICKS_PER_PASS && !simulation.gameOver; ticks++)
+    {
+        for (; applied[player] < received[player] && ring[applied[player] % MAX_BUFFERED_INPUTS].tick == simulation.tick; applied[player]++)
+        {
+            simulation.input(toDirection(ring[applied[player] % MAX_BUFFERED_INPUTS].input));
+        }
+        // a finished player's board plays on until it tops out, with no inputs left to wait for
+        if (simulation.gameOver || (simulation.tick >= confirmedTicks[player] && !finished[player]))
+        {
+            break;
+        }
+        simulation.step();
+    }
+    stats.ticksSimulated.fetch_add(std::uint64_t(ticks), std::memory_order_relaxed);
+}
+
+void MatchShard::queuePacket(int player)
+{
+    int opponent = player ^ 1;
+    int match = player / 2;
+    sendDue[player] = 0;
+    if (matchStates[match] != MatchState::PLAYING && matchStates[match] != MatchState::OVER)
+    {
+        return;
+    }
+
+    NetPacket& packet = io->packet;
+    packet.seed = matchSeeds[match];
+    packet.startLevel = matchStartLevels[match];
+    packet.ack = received[player];
+    // the opponent's inputs under their own sequence numbers, so the player can't tell it isn't talking to them
+    packet.setInputs(inputs[opponent], relayed[opponent], int(received[opponent] - relayed[opponent]),
+        confirmedTicks[opponent], finished[opponent] != 0);
+
+    mmsghdr& header = io->sendHeaders[numQueued];
+    io->sendVectors[numQueued].iov_len = std::size_t(packet.write(io->sendData[numQueued].data()));
+    header.msg_hdr.msg_name = addresses[player].bytes.data();
+    header.msg_hdr.msg_namelen = addresses[player].size;
+    numQueued++;
+    if (numQueued == BATCH_SIZE)
+    {
+        flushPackets();
+    }
+}
+
+void MatchShard::flushPackets()
+{
+    int first = 0;
+    while (first < numQueued)
+    {
+        int count = ::sendmmsg(socketHandle, io->sendHeaders.data() + first, unsigned(numQueued - first), 0);
+        if (count <= 0)
+        {
+            // a full queue loses the rest of the batch, which the next pass sends again
+            break;
+        }
+        stats.packetsSent.fetch_add(std::uint64_t(count), std::memory_order_relaxed);
+        first += count;
+    }
+    numQueued = 0;
+}
+
+void MatchShard::freeMatch(int match)
+{
+    if (matchStates[match] == MatchState::WAITING)
+    {
+        waitingMatch = -1;
+        removePlayer(match * 2);
+    }
+    else
+    {
+        removePlayer(match * 2);
+        removePlayer(match * 2 + 1);
+        stats.activeMatches.fetch_sub(1, std::memory_order_relaxed);
+    }
+    matchStates[match] = MatchState::FREE;
+    freeMatches.push_back(match);
+}
+
+int MatchShard::findPlayer(const ClientAddress& address) const
+{
+    for (std::size_t slot = ClientAddressHash()(address) & slotMask; playerSlots[slot] >= 0; slot = (slot + 1) & slotMask)
+    {
+        if (addresses[playerSlots[slot]] == address)
+        {
+            return playerSlots[slot];
+        }
+    }
+    return -1;
+}
+
+void MatchShard::addPlayer(int player)
+{
+    // never full, there are twice as many slots as players
+    std::size_t slot = ClientAddressHash()(addresses[player]) & slotMask;
+    while (playerSlots[slot] >= 0)
+    {
+        slot = (slot + 1) & slotMask;
+    }
+    playerSlots[slot] = player;
+}
+
+void MatchShard::removePlayer(int player)
+{
+    std::size_t slot = ClientAddressHash()(addresses[player]) & slotMask;
+    while (playerSlots[slot] != player)
+    {
+        slot = (slot + 1) & slotMask;
+    }
+
+    // players further along the run move back into the gap unless that would put them before
+    // the slot they hash to, so no lookup ever stops at an empty slot short of its player
+    std::size_t empty = slot;
+    for (std::size_t next = (empty + 1) & slotMask; playerSlots[next] >= 0; next = (next + 1) & slotMask)
+    {
+        std::size_t home = ClientAddressHash()(addresses[playerSlots[next]]) & slotMask;
+        if (((next - home) & slotMask) >= ((next - empty) & slotMask))
+        {
+            playerSlots[empty] = playerSlots[next];
+            empty = next;
+        }
+    }
+    playerSlots[empty] = -1;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "netplay.h"
+#include "simulation.h"
+
+// a client's address, the bytes of the sockaddr it sent from
+struct ClientAddress
+{
+    // room for a sockaddr_in6
+    std::array<std::uint8_t, 28> bytes = { 0 };
+    std::uint32_t size = 0;
+
+    bool operator==(const ClientAddress& other) const
+    {
+        return size == other.size && bytes == other.bytes;
+    }
+};
+
+struct ClientAddressHash
+{
+    std::size_t operator()(const ClientAddress& address) const
+    {
+        // FNV-1a
+        std::uint64_t hash = 0xCBF29CE484222325ull;
+        for (std::uint32_t i = 0; i < address.size; i++)
+        {
+            hash = (hash ^ address.bytes[i]) * 0x100000001B3ull;
+        }
+        return std::size_t(hash);
+    }
+};
+
+// counters only the shard's thread bumps, summed by the main thread for the printout every
+// few seconds. Aligned apart from the rest of the shard, which its thread is in on every packet
+struct alignas(64) ShardStats
+{
+    std::atomic<std::uint64_t> activeMatches{ 0 };
+    std::atomic<std::uint64_t> finishedMatches{ 0 };
+    // finished matches both players lasted the same ticks and completed the same rows in
+    std::atomic<std::uint64_t> drawnMatches{ 0 };
+    // a player went quiet or sent more than could be buffered
+    std::atomic<std::uint64_t> abandonedMatches{ 0 };
+    std::atomic<std::uint64_t> packetsReceived{ 0 };
+    std::atomic<std::uint64_t> packetsSent{ 0 };
+    std::atomic<std::uint64_t> ticksSimulated{ 0 };
+};
+
+// hosts versus matches for one core, speaking the protocol NetplaySession does
+//
+// a client connects to the server as if it were its peer: the first two hellos a shard hears
+// are paired into a match and only then answered, with the match's seed, and from then on the
+// server relays each player's inputs to the other, acknowledging them itself. Every player's
+// board is also played here from its inputs as they're confirmed, so the result of a match
+// is the server's and not whatever the clients claim.
+//
+// every shard has a socket of its own on the same port, and the kernel delivers a client to
+// the same one every time, so both players of a match are on one shard and shards share nothing.
+// That also means a player is only paired with one the kernel sent to the same shard, which is
+// why the server runs a single shard unless it's told otherwise.
+// Players are kept as a struct of arrays, two slots per match with the opponent at slot ^ 1,
+// so the passes over every player each tick only bring in the fields they use.
+//
+// Linux only, it waits on epoll and moves datagrams in batches with recvmmsg and sendmmsg
+class MatchShard
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // inputs kept per player, from the oldest one not yet both relayed and played on
+    static constexpr int MAX_BUFFERED_INPUTS = 256;
+    // pass interval, every player gets a packet at least this often, as the clients send them
+    static constexpr std::chrono::milliseconds TICK_INTERVAL = NetplaySession::SEND_INTERVAL;
+    // most ticks one board plays per pass, so a burst from one player can't hold up the rest
+    static constexpr int MAX_TICKS_PER_PASS = Simulation::TICKS_PER_SECOND;
+    // datagrams moved per recvmmsg or sendmmsg
+    static constexpr int BATCH_SIZE = 64;
+    // a waiting player stops being paired once this many hellos in a row haven't come, so the
+    // next one isn't matched with a client that gave up
+    static constexpr int MISSED_HELLOS = 3;
+    static constexpr std::chrono::milliseconds WAITING_TIMEOUT = NetplaySession::HELLO_INTERVAL * MISSED_HELLOS;
+
+    ShardStats stats;
+
+    // every match is allocated up front, so serving never allocates
+    explicit MatchShard(int maxMatches);
+    ~MatchShard();
+    MatchShard(const MatchShard&) = delete;
+    MatchShard& operator=(const MatchShard&) = delete;
+
+    // binds the shard's socket to the port every shard shares, returns false on failure
+    bool open(int port);
+    // serves until running is cleared, returns false if waiting on the socket fails
+    bool run(const std::atomic<bool>& running);
+private:
+    enum class MatchState : std::uint8_t
+    {
+        FREE,
+        // one player has said hello
+        WAITING,
+        PLAYING,
+        // both games are over, packets keep going out for a while so both clients hear it
+        OVER
+    };
+
+    // the platform's socket and message headers, kept out of this header
+    struct IoBuffers;
+
+    int maxMatches;
+    int socketHandle = -1;
+    int epollHandle = -1;
+    std::unique_ptr<IoBuffers> io;
+    int numQueued = 0;
+
+    // per match
+    std::vector<MatchState> matchStates;
+    std::vector<std::uint64_t> matchSeeds;
+    std::vector<std::int32_t> matchStartLevels;
+    std::vector<Clock::time_point> matchOverTimes;
+    std::vector<int> freeMatches;
+    int waitingMatch = -1;
+
+    // per player
+    std::vector<ClientAddress> addresses;
+    std::vector<Clock::time_point> lastHeard;
+    // inputs received from the player, which is what it gets acknowledged
+    std::vector<std::uint64_t> received;
+    // inputs of the player its opponent has acknowledged
+    std::vector<std::uint64_t> relayed;
+    // inputs of the player applied to its board here
+    std::vector<std::uint64_t> applied;
+    // the player has played every tick before this one and sent every input it made on them
+    std::vector<std::uint64_t> confirmedTicks;
+    // the player's game is over and every input it made is in
+    std::vector<std::uint8_t> finished;
+    // new inputs came in for the player's opponent, so it gets a packet before the next pass
+    std::vector<std::uint8_t> sendDue;
+    std::vector<int> duePlayers;
+    // ring indexed by sequence number
+    std::vector<std::array<ReplayEvent, MAX_BUFFERED_INPUTS>> inputs;
+    std::vector<Simulation> simulations;
+    // players by address, open addressing with linear probing over twice as many slots as
+    // there are players, so finding, adding and removing a player never allocates
+    std::vector<int> playerSlots;
+    std::size_t slotMask = 0;
+
+    // takes in every datagram waiting, then sends what came due
+    void receiveAll(Clock::time_point now);
+    void handlePacket(const ClientAddress& from, const NetPacket& packet, Clock::time_point now);
+    // a hello from an address with no match, which either waits or completes a match
+    void handleHello(const ClientAddress& from, const NetPacket& packet, Clock::time_point now);
+    // plays every board on through its confirmed inputs, ends and frees matches, sends every player a packet
+    void pass(Clock::time_point now);
+    void playInputs(int player);
+    void queuePacket(int player);
+    void flushPackets();
+    void freeMatch(int match);
+    // the player at this address, or -1
+    int findPlayer(const ClientAddress& address) const;
+    // adds a player by addresses[player], which mustn't already be in
+    void addPlayer(int player);
+    void removePlayer(int player);
+};
@@ -0,0 +1,149 @@
+#include "metrics.h"
+
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace
+{
+    struct CounterInfo
+    {
+        const char* name;
+        const char* labels;
+        const char* help;
+    };
+
+    // counters that share a name differ by their labels, and get their HELP and TYPE from the first
+    constexpr std::array<CounterInfo, NUM_METRIC_COUNTERS> COUNTERS =
+    { {
+        { "tetris_pieces_spawned_total", "", "Pieces spawned." },
+        { "tetris_line_clears_total", "{rows=\"1\"}", "Line clears by rows cleared, four or more count as 4." },
+        { "tetris_line_clears_total", "{rows=\"2\"}", nullptr },
+        { "tetris_line_clears_total", "{rows=\"3\"}", nullptr },
+        { "tetris_line_clears_total", "{rows=\"4\"}", nullptr },
+        { "tetris_inputs_total", "", "Inputs applied to the board, held key repeats included." },
+        { "tetris_ticks_total", "", "Simulation ticks run." },
+        { "tetris_frames_total", "", "Frames presented." }
+    } };
+
+    struct HistogramInfo
+    {
+        const char* name;
+        const char* help;
+    };
+
+    constexpr std::array<HistogramInfo, NUM_METRIC_HISTOGRAMS> HISTOGRAMS =
+    { {
+        { "tetris_frame_seconds", "Time to build, submit and present a frame." },
+        { "tetris_present_latency_seconds", "Time from the board changing to a frame showing it." },
+        { "tetris_tick_seconds", "Time to run a simulation tick and its inputs." }
+    } };
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    stop();
+}
+
+bool MetricsExporter::start(const char* path, std::chrono::milliseconds interval)
+{
+    stop();
+    this->path = path;
+    this->interval = interval;
+    if (!write())
+    {
+        return false;
+    }
+
+    stopping = false;
+    thread = std::thread([this]()
+    {
+        std::unique_lock<std::mutex> lock(stopMutex);
+        while (!stopRequested.wait_for(lock, this->interval, [this]() { return stopping; }))
+        {
+            // the file is written without the lock, so stop never waits on the disk for long
+            lock.unlock();
+            write();
+            lock.lock();
+        }
+    });
+    return true;
+}
+
+void MetricsExporter::stop()
+{
+    if (!thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopRequested.notify_one();
+    thread.join();
+    // whatever was recorded since the thread's last write, so the file ends on the game's final totals
+    write();
+}
+
+bool MetricsExporter::write() const
+{
+    std::string temporaryPath = path + ".tmp";
+    std::FILE* file = std::fopen(temporaryPath.c_str(), "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < NUM_METRIC_COUNTERS; i++)
+    {
+        const CounterInfo& counter = COUNTERS[i];
+        if (counter.help)
+        {
+            std::fprintf(file, "# HELP %s %s\n# TYPE %s counter\n", counter.name, counter.help, counter.name);
+        }
+        std::fprintf(file, "%s%s %llu\n", counter.name, counter.labels,
+            static_cast<unsigned long long>(metrics.count(MetricCounter(i))));
+    }
+
+    for (int i = 0; i < NUM_METRIC_HISTOGRAMS; i++)
+    {
+        const HistogramInfo& histogram = HISTOGRAMS[i];
+        std::fprintf(file, "# HELP %s %s\n# TYPE %s histogram\n", histogram.name, histogram.help, histogram.name);
+
+        // Prometheus buckets count everything up to their bound, and the count read here is
+        // the same total, even if samples land between reading one bucket and the next.
+        // Bounds are whole microseconds, so six decimals write them exactly
+        std::uint64_t total = 0;
+        for (int bucket = 0; bucket < Metrics::NUM_BUCKETS; bucket++)
+        {
+            total += metrics.bucketCount(MetricHistogram(i), bucket);
+            if (bucket < Metrics::NUM_BUCKETS - 1)
+            {
+                std::fprintf(file, "%s_bucket{le=\"%.6f\"} %llu\n", histogram.name, double(std::uint64_t(1) << bucket) / 1e6,
+                    static_cast<unsigned long long>(total));
+            }
+            else
+            {
+                std::fprintf(file, "%s_bucket{le=\"+Inf\"} %llu\n", histogram.name, static_cast<unsigned long long>(total));
+            }
+        }
+        std::fprintf(file, "%s_sum %.9f\n%s_count %llu\n", histogram.name, double(metrics.sumNanoseconds(MetricHistogram(i))) / 1e9,
+            histogram.name, static_cast<unsigned long long>(total));
+    }
+
+    if (std::fclose(file) != 0)
+    {
+        return false;
+    }
+#if defined(_WIN32)
+    // rename won't replace a file on Windows, and removing it first would leave a moment with no file
+    return MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+}
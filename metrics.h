@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// counters and histograms of how a game is going, bumped with relaxed atomics from whichever
+// thread sees the event and exported by MetricsExporter from a thread of its own, so the game
+// never waits on a lock or on I/O to record anything
+//
+// recording only needs metrics.h, as with the profiler, headless tools that never export
+// don't have to link metrics.cpp
+
+enum class MetricCounter
+{
+    PIECES_SPAWNED,
+    // clears by how many rows they took out, cascades of more than four count as four
+    SINGLE_CLEARS,
+    DOUBLE_CLEARS,
+    TRIPLE_CLEARS,
+    QUADRUPLE_CLEARS,
+    // inputs applied to the board, held key repeats included
+    INPUTS,
+    TICKS,
+    FRAMES
+};
+
+constexpr int NUM_METRIC_COUNTERS = int(MetricCounter::FRAMES) + 1;
+
+enum class MetricHistogram
+{
+    // building, submitting and presenting a frame
+    FRAME_TIME,
+    // from the board first changing to a frame showing it
+    PRESENT_LATENCY,
+    // one simulation tick, with the inputs applied on it
+    TICK_COST
+};
+
+constexpr int NUM_METRIC_HISTOGRAMS = int(MetricHistogram::TICK_COST) + 1;
+
+class Metrics
+{
+public:
+    // bucket n holds samples of up to 2^n microseconds, the last one anything longer
+    static constexpr int NUM_BUCKETS = 22;
+
+    void add(MetricCounter counter, std::uint64_t amount = 1)
+    {
+        counters[int(counter)].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    // counts a clear of this many rows
+    void addClear(int rows)
+    {
+        int index = int(MetricCounter::SINGLE_CLEARS) + (rows < 4 ? rows : 4) - 1;
+        add(MetricCounter(index));
+    }
+
+    void observe(MetricHistogram histogram, std::chrono::nanoseconds elapsed)
+    {
+        std::uint64_t nanoseconds = elapsed.count() > 0 ? std::uint64_t(elapsed.count()) : 0;
+        std::uint64_t microseconds = (nanoseconds + 999) / 1000;
+        int bucket = 0;
+        while (bucket < NUM_BUCKETS - 1 && (std::uint64_t(1) << bucket) < microseconds)
+        {
+            bucket++;
+        }
+
+        Histogram& samples = histograms[int(histogram)];
+        samples.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        samples.sumNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count(MetricCounter counter) const
+    {
+        return counters[int(counter)].value.load(std::memory_order_relaxed);
+    }
+
+    // samples in one bucket, not counting the buckets below it
+    std::uint64_t bucketCount(MetricHistogram histogram, int bucket) const
+    {
+        return histograms[int(histogram)].buckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t sumNanoseconds(MetricHistogram histogram) const
+    {
+        return histograms[int(histogram)].sumNanoseconds.load(std::memory_order_relaxed);
+    }
+private:
+    // the simulation thread bumps ticks and inputs while the render thread bumps frames, so each
+    // counter has a line of its own rather than one bouncing between the two
+    struct alignas(64) Counter
+    {
+        std::atomic<std::uint64_t> value;
+    };
+
+    struct alignas(64) Histogram
+    {
+        std::array<std::atomic<std::uint64_t>, NUM_BUCKETS> buckets;
+        std::atomic<std::uint64_t> sumNanoseconds;
+    };
+
+    std::array<Counter, NUM_METRIC_COUNTERS> counters;
+    std::array<Histogram, NUM_METRIC_HISTOGRAMS> histograms;
+};
+
+// the one set the game records to and the exporter reads
+inline Metrics metrics;
+
+// times frames for the metrics, however many presents a frame takes
+class FrameTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // call whenever there's something new to draw, latency counts from the oldest change not yet shown
+    void changed()
+    {
+        if (!pending)
+        {
+            pending = true;
+            changedAt = Clock::now();
+        }
+    }
+
+    // call before and after presenting a frame
+    void begin()
+    {
+        start = Clock::now();
+    }
+
+    void end()
+    {
+        Clock::time_point now = Clock::now();
+        metrics.observe(MetricHistogram::FRAME_TIME, now - start);
+        if (pending)
+        {
+            metrics.observe(MetricHistogram::PRESENT_LATENCY, now - changedAt);
+            pending = false;
+        }
+        metrics.add(MetricCounter::FRAMES);
+    }
+private:
+    bool pending = false;
+    Clock::time_point changedAt;
+    Clock::time_point start;
+};
+
+// rewrites a file with every metric in the Prometheus text format every so often, from a
+// thread of its own. Each write goes to a temporary file that's then renamed over the last,
+// so a scraper, e.g. node_exporter's textfile collector, never reads half a file
+class MetricsExporter
+{
+public:
+    MetricsExporter() = default;
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+    ~MetricsExporter();
+
+    // writes the file once before starting the thread, returns false if it can't be written
+    bool start(const char* path, std::chrono::milliseconds interval = std::chrono::seconds(5));
+    bool isRunning() const { return thread.joinable(); }
+    // writes the file a last time and stops the thread
+    void stop();
+private:
+    std::string path;
+    std::chrono::milliseconds interval{ 0 };
+    std::thread thread;
+    // only between the exporter thread and stop, the game never takes it
+    std::mutex stopMutex;
+    std::condition_variable stopRequested;
+    bool stopping = false;
+
+    bool write() const;
+};
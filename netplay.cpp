@@ -0,0 +1,564 @@
+#include "netplay.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// packet layout, all integers are LEB128 varints as in replays:
+//   "TNET" version seed startLevel flags ack tick firstSequence numInputs
+//   then one varint per input: (ticks since the previous input << 3) | input, the first
+//   one counted from tick 0
+// ack is how many of the receiver's inputs the sender has, tick is how far the sender's
+// game has got, and flags bit 0 is set once the sender's game is over and every input
+// it made is in the packet
+
+namespace
+{
+    constexpr std::uint8_t MAGIC[] = { 'T', 'N', 'E', 'T' };
+    constexpr int INPUT_BITS = 3;
+    constexpr std::uint64_t INPUT_MASK = (1u << INPUT_BITS) - 1;
+    constexpr std::uint64_t FINISHED_FLAG = 1;
+
+    class PacketWriter
+    {
+    public:
+        explicit PacketWriter(std::uint8_t* data) : data(data)
+        {
+        }
+
+        std::uint8_t* data;
+        int size = 0;
+
+        void writeByte(std::uint8_t byte)
+        {
+            data[size++] = byte;
+        }
+
+        void writeVarint(std::uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                data[size++] = std::uint8_t(value | 0x80);
+                value >>= 7;
+            }
+            data[size++] = std::uint8_t(value);
+        }
+    };
+
+    class PacketReader
+    {
+    public:
+        PacketReader(const std::uint8_t* data, int size) : data(data), size(size)
+        {
+        }
+
+        bool readByte(std::uint8_t& byte)
+        {
+            if (position == size)
+            {
+                return false;
+            }
+            byte = data[position++];
+            return true;
+        }
+
+        bool readVarint(std::uint64_t& value)
+        {
+            value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                std::uint8_t byte;
+                if (!readByte(byte))
+                {
+                    return false;
+                }
+                value |= std::uint64_t(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    private:
+        const std::uint8_t* data;
+        int size;
+        int position = 0;
+    };
+
+    // the peer's address as the OS sees it, compared field by field since the padding isn't always zeroed
+    bool sameAddress(const sockaddr_storage& a, const sockaddr_storage& b)
+    {
+        if (a.ss_family != b.ss_family)
+        {
+            return false;
+        }
+        if (a.ss_family == AF_INET)
+        {
+            const sockaddr_in& a4 = reinterpret_cast<const sockaddr_in&>(a);
+            const sockaddr_in& b4 = reinterpret_cast<const sockaddr_in&>(b);
+            return a4.sin_port == b4.sin_port && std::memcmp(&a4.sin_addr, &b4.sin_addr, sizeof(a4.sin_addr)) == 0;
+        }
+        if (a.ss_family == AF_INET6)
+        {
+            const sockaddr_in6& a6 = reinterpret_cast<const sockaddr_in6&>(a);
+            const sockaddr_in6& b6 = reinterpret_cast<const sockaddr_in6&>(b);
+            return a6.sin6_port == b6.sin6_port && std::memcmp(&a6.sin6_addr, &b6.sin6_addr, sizeof(a6.sin6_addr)) == 0;
+        }
+        return false;
+    }
+
+#if defined(_WIN32)
+    using SocketHandle = SOCKET;
+
+    bool startSockets()
+    {
+        static bool started = []()
+        {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        return started;
+    }
+
+    void closeSocket(SocketHandle handle)
+    {
+        closesocket(handle);
+    }
+
+    bool setNonBlocking(SocketHandle handle)
+    {
+        u_long nonBlocking = 1;
+        return ioctlsocket(handle, FIONBIO, &nonBlocking) == 0;
+    }
+
+    bool wouldBlock()
+    {
+        // an ICMP port unreachable from a peer that isn't up yet shows up as a reset, which is no reason to stop
+        int error = WSAGetLastError();
+        return error == WSAEWOULDBLOCK || error == WSAECONNRESET;
+    }
+#else
+    using SocketHandle = int;
+
+    bool startSockets()
+    {
+        return true;
+    }
+
+    void closeSocket(SocketHandle handle)
+    {
+        ::close(handle);
+    }
+
+    bool setNonBlocking(SocketHandle handle)
+    {
+        int flags = fcntl(handle, F_GETFL, 0);
+        return flags >= 0 && fcntl(handle, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    bool wouldBlock()
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED;
+    }
+#endif
+}
+
+static_assert(sizeof(sockaddr_storage) <= 128, "the peer's address must fit in UdpSocket::peerAddress");
+
+int NetPacket::write(std::uint8_t* data) const
+{
+    PacketWriter packet(data);
+    for (std::uint8_t byte : MAGIC)
+    {
+        packet.writeByte(byte);
+    }
+    packet.writeVarint(VERSION);
+    packet.writeVarint(seed);
+    packet.writeVarint(std::uint64_t(startLevel));
+    packet.writeVarint(finished ? FINISHED_FLAG : 0);
+    packet.writeVarint(ack);
+    packet.writeVarint(tick);
+    packet.writeVarint(firstSequence);
+    packet.writeVarint(std::uint64_t(numInputs));
+    std::uint64_t previousTick = 0;
+    for (int i = 0; i < numInputs; i++)
+    {
+        packet.writeVarint(((inputs[i].tick - previousTick) << INPUT_BITS) | std::uint64_t(inputs[i].input));
+        previousTick = inputs[i].tick;
+    }
+    return packet.size;
+}
+
+bool NetPacket::read(const std::uint8_t* data, int size)
+{
+    PacketReader packet(data, size);
+    for (std::uint8_t byte : MAGIC)
+    {
+        std::uint8_t read;
+        if (!packet.readByte(read) || read != byte)
+        {
+            return false;
+        }
+    }
+
+    std::uint64_t version, level, flags, count;
+    if (!packet.readVarint(version) || version != VERSION
+        || !packet.readVarint(seed) || !packet.readVarint(level) || level > Simulation::MAX_LEVEL
+        || !packet.readVarint(flags) || !packet.readVarint(ack) || !packet.readVarint(tick)
+        || !packet.readVarint(firstSequence) || !packet.readVarint(count) || count > MAX_INPUTS)
+    {
+        return false;
+    }
+    startLevel = int(level);
+    finished = (flags & FINISHED_FLAG) != 0;
+    numInputs = int(count);
+
+    std::uint64_t previousTick = 0;
+    for (int i = 0; i < numInputs; i++)
+    {
+        std::uint64_t value;
+        if (!packet.readVarint(value) || (value & INPUT_MASK) >= std::uint64_t(ReplayInput::END))
+        {
+            return false;
+        }
+        previousTick += value >> INPUT_BITS;
+        inputs[i] = { previousTick, ReplayInput(value & INPUT_MASK) };
+    }
+    return true;
+}
+
+UdpSocket::~UdpSocket()
+{
+    close();
+}
+
+bool UdpSocket::open(int localPort, const char* peerHost, int peerPort)
+{
+    close();
+    if (!startSockets())
+    {
+        return false;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    char portName[8];
+    std::snprintf(portName, sizeof(portName), "%d", peerPort);
+    addrinfo* peer = nullptr;
+    if (getaddrinfo(peerHost, portName, &hints, &peer) != 0 || !peer)
+    {
+        return false;
+    }
+
+    // listen on every address of the peer's family
+    hints.ai_family = peer->ai_family;
+    hints.ai_flags = AI_PASSIVE;
+    std::snprintf(portName, sizeof(portName), "%d", localPort);
+    addrinfo* local = nullptr;
+    if (getaddrinfo(nullptr, portName, &hints, &local) != 0 || !local)
+    {
+        freeaddrinfo(peer);
+        return false;
+    }
+
+    SocketHandle socketHandle = socket(peer->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+    bool opened = socketHandle != SocketHandle(INVALID_HANDLE);
+    if (opened && (bind(socketHandle, local->ai_addr, int(local->ai_addrlen)) != 0 || !setNonBlocking(socketHandle)))
+    {
+        closeSocket(socketHandle);
+        opened = false;
+    }
+    if (opened)
+    {
+        handle = std::intptr_t(socketHandle);
+        std::memcpy(peerAddress.data(), peer->ai_addr, peer->ai_addrlen);
+        peerAddressSize = int(peer->ai_addrlen);
+    }
+
+    freeaddrinfo(local);
+    freeaddrinfo(peer);
+    return opened;
+}
+
+bool UdpSocket::send(const std::uint8_t* data, int size)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+    int sent = int(sendto(SocketHandle(handle), reinterpret_cast<const char*>(data), size, 0,
+        reinterpret_cast<const sockaddr*>(peerAddress.data()), peerAddressSize));
+    return sent == size;
+}
+
+int UdpSocket::receive(std::uint8_t* data, int capacity)
+{
+    if (!isOpen())
+    {
+        return -1;
+    }
+
+    const sockaddr_storage& peer = *reinterpret_cast<const sockaddr_storage*>(peerAddress.data());
+    for (;;)
+    {
+        sockaddr_storage from;
+        socklen_t fromSize = sizeof(from);
+        int received = int(recvfrom(SocketHandle(handle), reinterpret_cast<char*>(data), capacity, 0,
+            reinterpret_cast<sockaddr*>(&from), &fromSize));
+        if (received < 0)
+        {
+            return wouldBlock() ? 0 : -1;
+        }
+        if (received > 0 && sameAddress(from, peer))
+        {
+            return received;
+        }
+    }
+}
+
+void UdpSocket::close()
+{
+    if (isOpen())
+    {
+        closeSocket(SocketHandle(handle));
+        handle = INVALID_HANDLE;
+    }
+}
+
+bool NetplaySession::open(int localPort, const char* peerHost, int peerPort)
+{
+    return socket.open(localPort, peerHost, peerPort);
+}
+
+bool NetplaySession::connect(std::uint64_t seed, int startLevel, Clock::duration timeout)
+{
+    reset(seed, startLevel);
+    auto giveUpAt = Clock::now() + timeout;
+    std::array<std::uint8_t, NetPacket::MAX_SIZE> data;
+    NetPacket packet;
+    while (Clock::now() < giveUpAt)
+    {
+        sendPacket();
+        auto nextHello = Clock::now() + HELLO_INTERVAL;
+        while (Clock::now() < nextHello)
+        {
+            int size = socket.receive(data.data(), int(data.size()));
+            if (size <= 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (!packet.read(data.data(), size))
+            {
+                continue;
+            }
+
+            // both ends pick the same one of the two, whichever heard from the other first
+            if (packet.seed < seed || (packet.seed == seed && packet.startLevel < startLevel))
+            {
+                reset(packet.seed, packet.startLevel);
+            }
+            // the peer may already be playing, and this packet can carry its first inputs
+            readPacket(packet);
+            lastReceive = Clock::now();
+            sendPacket();
+            return true;
+        }
+    }
+    return false;
+}
+
+void NetplaySession::localInput(std::uint64_t tick, Direction direction)
+{
+    if (numUnacked == MAX_UNACKED_INPUTS)
+    {
+        // an input the peer never gets would split the two games apart
+        overflowed = true;
+        return;
+    }
+    unacked[localSequence % MAX_UNACKED_INPUTS] = { tick, toReplayInput(direction) };
+    localSequence++;
+    numUnacked++;
+    inputsSinceSend = true;
+}
+
+void NetplaySession::update()
+{
+    auto now = Clock::now();
+    if (inputsSinceSend || now >= nextSendTime())
+    {
+        sendPacket();
+    }
+
+    if (matchOverTime == Clock::time_point() && local.gameOver && remoteFinished && remote.gameOver)
+    {
+        matchOverTime = now;
+    }
+}
+
+void NetplaySession::receive()
+{
+    std::array<std::uint8_t, NetPacket::MAX_SIZE> data;
+    NetPacket packet;
+    for (;;)
+    {
+        int size = socket.receive(data.data(), int(data.size()));
+        if (size <= 0)
+        {
+            return;
+        }
+        if (packet.read(data.data(), size) && readPacket(packet))
+        {
+            lastReceive = Clock::now();
+        }
+    }
+}
+
+bool NetplaySession::isDisconnected() const
+{
+    return overflowed || Clock::now() - lastReceive > TIMEOUT;
+}
+
+bool NetplaySession::isMatchOver() const
+{
+    return matchOverTime != Clock::time_point() && Clock::now() - matchOverTime >= LINGER;
+}
+
+void NetplaySession::sendPacket()
+{
+    NetPacket packet;
+    packet.seed = matchSeed;
+    packet.startLevel = matchStartLevel;
+    packet.ack = remoteReceived;
+    // the oldest unacknowledged inputs first, the rest go once these are acknowledged
+    packet.setInputs(unacked, localSequence - std::uint64_t(numUnacked), numUnacked, local.tick, local.gameOver);
+
+    std::array<std::uint8_t, NetPacket::MAX_SIZE> data;
+    socket.send(data.data(), packet.write(data.data()));
+    lastSend = Clock::now();
+    inputsSinceSend = false;
+}
+
+bool NetplaySession::readPacket(const NetPacket& packet)
+{
+    if (packet.seed != matchSeed || packet.startLevel != matchStartLevel)
+    {
+        // hellos from before the peer settled on this match's seed end up here too
+        return false;
+    }
+
+    // inputs from earlier packets come again until they're acknowledged. A gap can't happen,
+    // the peer always starts from the first input it has no acknowledgement for
+    if (packet.firstSequence > remoteReceived)
+    {
+        return false;
+    }
+    int skip = int(std::min<std::uint64_t>(remoteReceived - packet.firstSequence, std::uint64_t(packet.numInputs)));
+    for (int i = skip; i < packet.numInputs; i++)
+    {
+        // the peer said it was done with ticks before remoteConfirmedTick
+        if (packet.inputs[i].tick < remoteConfirmedTick)
+        {
+            return false;
+        }
+    }
+
+    // what the peer has of ours doesn't need sending again
+    std::uint64_t firstUnacked = localSequence - std::uint64_t(numUnacked);
+    if (packet.ack > firstUnacked && packet.ack <= localSequence)
+    {
+        numUnacked = int(localSequence - packet.ack);
+    }
+
+    std::uint64_t rollbackTick = ~std::uint64_t(0);
+    for (int i = skip; i < packet.numInputs; i++)
+    {
+        const ReplayEvent& input = packet.inputs[i];
+        // drop inputs from before the confirmed tick, no rollback goes back that far
+        while (remoteReceived - remoteOldest == MAX_UNACKED_INPUTS && remoteOldest < remoteApplied
+            && remoteInputs[remoteOldest % MAX_UNACKED_INPUTS].tick < remoteConfirmedTick)
+        {
+            remoteOldest++;
+        }
+        if (remoteReceived - remoteOldest == MAX_UNACKED_INPUTS)
+        {
+            overflowed = true;
+            return false;
+        }
+
+        remoteInputs[remoteReceived % MAX_UNACKED_INPUTS] = input;
+        remoteReceived++;
+        rollbackTick = std::min(rollbackTick, input.tick);
+    }
+
+    std::uint64_t newConfirmedTick = std::max(remoteConfirmedTick, packet.tick);
+    remoteFinished = remoteFinished || (packet.finished && remoteReceived == packet.firstSequence + std::uint64_t(packet.numInputs));
+
+    // every prediction was no input, so one on a tick already played was a misprediction
+    if (rollbackTick < remote.tick)
+    {
+        std::uint64_t predictedTick = remote.tick;
+        remote.restore(savedStates[rollbackTick % ROLLBACK_TICKS]);
+        // inputs applied on the tick rolled back to are applied again
+        while (remoteApplied > remoteOldest && remoteInputs[(remoteApplied - 1) % MAX_UNACKED_INPUTS].tick >= rollbackTick)
+        {
+            remoteApplied--;
+        }
+        rollbacks++;
+        resimulatedTicks += predictedTick - rollbackTick;
+        predictRemote(predictedTick);
+    }
+    remoteConfirmedTick = newConfirmedTick;
+    return true;
+}
+
+void NetplaySession::predictRemote(std::uint64_t tick)
+{
+    // every saved state a rollback could need has to stay in the ring
+    std::uint64_t target = std::min(tick, remoteConfirmedTick + ROLLBACK_TICKS - 1);
+    while (remote.tick < target && !remote.gameOver)
+    {
+        remote.snapshot(savedStates[remote.tick % ROLLBACK_TICKS]);
+        for (; remoteApplied < remoteReceived && remoteInputs[remoteApplied % MAX_UNACKED_INPUTS].tick == remote.tick; remoteApplied++)
+        {
+            remote.input(toDirection(remoteInputs[remoteApplied % MAX_UNACKED_INPUTS].input));
+        }
+        remote.step();
+    }
+}
+
+void NetplaySession::reset(std::uint64_t seed, int startLevel)
+{
+    matchSeed = seed;
+    matchStartLevel = startLevel;
+    local = Simulation(seed, RandomizerMode::BAG, startLevel);
+    remote = Simulation(seed, RandomizerMode::BAG, startLevel);
+    remoteConfirmedTick = 0;
+    remoteFinished = false;
+    rollbacks = 0;
+    resimulatedTicks = 0;
+    matchOverTime = Clock::time_point();
+    overflowed = false;
+    inputsSinceSend = false;
+    numUnacked = 0;
+    localSequence = 0;
+    remoteOldest = 0;
+    remoteApplied = 0;
+    remoteReceived = 0;
+}
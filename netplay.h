@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "replay.h"
+#include "simulation.h"
+
+// a non-blocking UDP socket that only talks to one peer
+class UdpSocket
+{
+public:
+    UdpSocket() = default;
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+    ~UdpSocket();
+
+    // binds localPort and resolves the peer, returns false if either fails
+    bool open(int localPort, const char* peerHost, int peerPort);
+    bool isOpen() const { return handle != INVALID_HANDLE; }
+    // returns false if the datagram couldn't be sent, a lost datagram still counts as sent
+    bool send(const std::uint8_t* data, int size);
+    // size of the next datagram from the peer, 0 if none is waiting or -1 on an error,
+    // datagrams from anyone else are dropped
+    int receive(std::uint8_t* data, int capacity);
+    void close();
+private:
+    // a SOCKET on Windows, a file descriptor everywhere else
+    static constexpr std::intptr_t INVALID_HANDLE = -1;
+
+    std::intptr_t handle = INVALID_HANDLE;
+    // a sockaddr_storage, kept as bytes so the platform headers stay out of this one
+    alignas(8) std::array<std::uint8_t, 128> peerAddress = { 0 };
+    int peerAddressSize = 0;
+};
+
+// one packet of the versus protocol as it's sent, see netplay.cpp for the layout
+//
+// each end sends its inputs, numbered from 0, starting from the first one the receiver hasn't
+// acknowledged, so a packet that's lost is made up for by the next
+struct NetPacket
+{
+    static constexpr int MAX_INPUTS = 64;
+    static constexpr int MAX_SIZE = 1024;
+    static constexpr int VERSION = 1;
+
+    // both ends of a match play the same seed and level, packets for another are ignored
+    std::uint64_t seed = 0;
+    int startLevel = Simulation::MIN_LEVEL;
+    // the sender's game is over and every input it made is in this packet
+    bool finished = false;
+    // how many of the receiver's inputs the sender has
+    std::uint64_t ack = 0;
+    // the sender has played every tick before this one and sent every input it made on them
+    std::uint64_t tick = 0;
+    // sequence number of inputs[0]
+    std::uint64_t firstSequence = 0;
+    int numInputs = 0;
+    std::array<ReplayEvent, MAX_INPUTS> inputs;
+
+    // returns the size written, data must have room for MAX_SIZE bytes
+    int write(std::uint8_t* data) const;
+    // returns false if the data isn't a well formed packet of this version
+    bool read(const std::uint8_t* data, int size);
+
+    // takes as many of the numPending inputs from first on as fit, out of a ring indexed by
+    // sequence number, and works out tick and finished from the sender's game, as a receiver
+    // can only count on the ticks before the first input left out
+    template <std::size_t RingSize>
+    void setInputs(const std::array<ReplayEvent, RingSize>& ring, std::uint64_t first, int numPending,
+        std::uint64_t playedTick, bool gameOver)
+    {
+        firstSequence = first;
+        numInputs = numPending < MAX_INPUTS ? numPending : MAX_INPUTS;
+        for (int i = 0; i < numInputs; i++)
+        {
+            inputs[i] = ring[(first + std::uint64_t(i)) % RingSize];
+        }
+        tick = numInputs < numPending ? ring[(first + std::uint64_t(numInputs)) % RingSize].tick : playedTick;
+        finished = gameOver && numInputs == numPending;
+    }
+};
+
+// a versus match with one peer, each player on their own board dealt from the same seed
+//
+// only inputs cross the network, as the replay format has them: each packet carries every
+// local input the peer hasn't acknowledged yet and the tick the local game has reached, so
+// a lost packet is made up for by the next one. The peer's board is predicted to get no
+// inputs, which is right on most ticks, and runs on ahead of what's been heard from it so it
+// keeps up with the local clock. Its state is saved on every tick it's predicted through, so
+// when an input turns up for a tick already predicted it's restored to that tick and played
+// forward again, rather than waiting a round trip for every tick like lockstep would.
+//
+// the boards don't affect each other, so the local one never needs rolling back
+class NetplaySession
+{
+public:
+    // the peer's board never gets further than this many ticks past what's confirmed, which
+    // bounds how far back a rollback goes and how many ticks it simulates again
+    static constexpr int ROLLBACK_TICKS = Simulation::TICKS_PER_SECOND / 2;
+    // local inputs sent but not yet acknowledged, one more ends the match
+    static constexpr int MAX_UNACKED_INPUTS = 1024;
+    // how often packets go out when there are no new inputs to send
+    static constexpr std::chrono::milliseconds SEND_INTERVAL{ 16 };
+    // how often connect says hello while it waits
+    static constexpr std::chrono::milliseconds HELLO_INTERVAL{ 100 };
+    // the peer is given up on when nothing has been heard from it for this long
+    static constexpr std::chrono::seconds TIMEOUT{ 5 };
+    // packets keep going out this long after the match is over, in case the last ones were lost
+    static constexpr std::chrono::seconds LINGER{ 1 };
+
+    using Clock = std::chrono::steady_clock;
+
+    Simulation local;
+    // the peer's board as predicted up to the local tick
+    Simulation remote;
+    // the peer has played every tick before this one and every input it made on them is known
+    std::uint64_t remoteConfirmedTick = 0;
+    // the peer's game is over and every input of it is known, so remote is final
+    bool remoteFinished = false;
+    // how many times the peer's board was rolled back, and how many ticks it played again for them
+    std::uint64_t rollbacks = 0;
+    std::uint64_t resimulatedTicks = 0;
+
+    // returns false if the socket can't be opened
+    bool open(int localPort, const char* peerHost, int peerPort);
+    // sends empty packets until one comes back, then sets both boards up with the lower of
+    // the two seeds and its level, so both ends play the same pieces. Returns false if the
+    // wait times out
+    bool connect(std::uint64_t seed, int startLevel, Clock::duration timeout);
+    std::uint64_t seed() const { return matchSeed; }
+
+    // queues an input applied to the local board on a tick, to be sent with the next packet
+    void localInput(std::uint64_t tick, Direction direction);
+    // sends a packet if there's something new or SEND_INTERVAL has passed since the last
+    void update();
+    // takes in every packet waiting, rolling the peer's board back when one has inputs it
+    // wasn't predicted to make
+    void receive();
+    // plays the peer's board on to a tick of the local clock, as far as ROLLBACK_TICKS allows,
+    // saving it on every tick and applying the peer's inputs known for it
+    void predictRemote(std::uint64_t tick);
+    // when update next has to send a packet
+    Clock::time_point nextSendTime() const { return lastSend + SEND_INTERVAL; }
+    // nothing was heard from the peer for TIMEOUT, or the local inputs outgrew the unacked buffer
+    bool isDisconnected() const;
+    // both games are over and every input is known at both ends, give or take a lost packet
+    bool isMatchOver() const;
+private:
+    UdpSocket socket;
+    std::uint64_t matchSeed = 0;
+    int matchStartLevel = Simulation::MIN_LEVEL;
+    Clock::time_point lastSend;
+    Clock::time_point lastReceive;
+    // when both games were first seen over, or the epoch while they aren't
+    Clock::time_point matchOverTime;
+    bool overflowed = false;
+    bool inputsSinceSend = false;
+
+    // local inputs from localSequence - numUnacked on, ring indexed by sequence number
+    std::array<ReplayEvent, MAX_UNACKED_INPUTS> unacked;
+    int numUnacked = 0;
+    std::uint64_t localSequence = 0;
+
+    // peer inputs from remoteOldest up to remoteReceived, in order, ring indexed by sequence number.
+    // applied ones are kept until they're before remoteConfirmedTick, where no rollback can go
+    std::array<ReplayEvent, MAX_UNACKED_INPUTS> remoteInputs;
+    std::uint64_t remoteOldest = 0;
+    // sequence numbers of the next peer input to apply and the next expected from the network
+    std::uint64_t remoteApplied = 0;
+    std::uint64_t remoteReceived = 0;
+    // remote at the start of each of the last ROLLBACK_TICKS ticks, before its inputs, indexed by tick
+    std::array<Simulation::State, ROLLBACK_TICKS> savedStates;
+
+    void sendPacket();
+    // returns false if the packet is for another match or doesn't fit with what came before
+    bool readPacket(const NetPacket& packet);
+    void reset(std::uint64_t seed, int startLevel);
+};
@@ -0,0 +1,443 @@
+#include "placement.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+// each board column is one 16 bit lane, so the whole height profile of a
+// placement is a single register on AVX2, or two on SSE2/NEON
+// define TETRIS_NO_SIMD to force the portable version
+#if !defined(TETRIS_NO_SIMD) && defined(__AVX2__)
+#define PLACEMENT_KERNEL_AVX2
+#include <immintrin.h>
+#elif !defined(TETRIS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PLACEMENT_KERNEL_SSE2
+#include <emmintrin.h>
+#elif !defined(TETRIS_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#define PLACEMENT_KERNEL_NEON
+#include <arm_neon.h>
+#else
+#define PLACEMENT_KERNEL_SCALAR
+#endif
+
+namespace
+{
+    constexpr int NUM_LANES = 16;
+    static_assert(Board::NUM_COLS <= NUM_LANES, "every column needs a lane");
+
+#if defined(PLACEMENT_KERNEL_AVX2)
+    struct Lanes
+    {
+        __m256i v;
+    };
+
+    inline Lanes load(const std::int16_t* values) { return { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values)) }; }
+    inline Lanes splat(int value) { return { _mm256_set1_epi16(std::int16_t(value)) }; }
+    inline Lanes operator+(Lanes a, Lanes b) { return { _mm256_add_epi16(a.v, b.v) }; }
+    inline Lanes operator-(Lanes a, Lanes b) { return { _mm256_sub_epi16(a.v, b.v) }; }
+    inline Lanes operator&(Lanes a, Lanes b) { return { _mm256_and_si256(a.v, b.v) }; }
+    inline Lanes max(Lanes a, Lanes b) { return { _mm256_max_epi16(a.v, b.v) }; }
+    inline Lanes abs(Lanes a) { return { _mm256_abs_epi16(a.v) }; }
+
+    // lane n gets lane n + 1, the last lane gets 0
+    inline Lanes next(Lanes a)
+    {
+        __m256i high = _mm256_permute2x128_si256(a.v, a.v, 0x81);
+        return { _mm256_alignr_epi8(high, a.v, 2) };
+    }
+
+    inline int sum(Lanes a)
+    {
+        __m256i pairs = _mm256_madd_epi16(a.v, _mm256_set1_epi16(1));
+        __m128i quads = _mm_add_epi32(_mm256_castsi256_si128(pairs), _mm256_extracti128_si256(pairs, 1));
+        quads = _mm_add_epi32(quads, _mm_shuffle_epi32(quads, 0x4E));
+        quads = _mm_add_epi32(quads, _mm_shuffle_epi32(quads, 0xB1));
+        return _mm_cvtsi128_si32(quads);
+    }
+
+    inline int minimum(Lanes a)
+    {
+        __m128i m = _mm_min_epi16(_mm256_castsi256_si128(a.v), _mm256_extracti128_si256(a.v, 1));
+        m = _mm_min_epi16(m, _mm_shuffle_epi32(m, 0x4E));
+        m = _mm_min_epi16(m, _mm_shuffle_epi32(m, 0xB1));
+        m = _mm_min_epi16(m, _mm_srli_epi32(m, 16));
+        return std::int16_t(_mm_cvtsi128_si32(m));
+    }
+
+    inline int maximum(Lanes a)
+    {
+        __m128i m = _mm_max_epi16(_mm256_castsi256_si128(a.v), _mm256_extracti128_si256(a.v, 1));
+        m = _mm_max_epi16(m, _mm_shuffle_epi32(m, 0x4E));
+        m = _mm_max_epi16(m, _mm_shuffle_epi32(m, 0xB1));
+        m = _mm_max_epi16(m, _mm_srli_epi32(m, 16));
+        return std::int16_t(_mm_cvtsi128_si32(m));
+    }
+#elif defined(PLACEMENT_KERNEL_SSE2)
+    struct Lanes
+    {
+        __m128i low;
+        __m128i high;
+    };
+
+    inline Lanes load(const std::int16_t* values)
+    {
+        return { _mm_loadu_si128(reinterpret_cast<const __m128i*>(values)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + 8)) };
+    }
+    inline Lanes splat(int value) { return { _mm_set1_epi16(std::int16_t(value)), _mm_set1_epi16(std::int16_t(value)) }; }
+    inline Lanes operator+(Lanes a, Lanes b) { return { _mm_add_epi16(a.low, b.low), _mm_add_epi16(a.high, b.high) }; }
+    inline Lanes operator-(Lanes a, Lanes b) { return { _mm_sub_epi16(a.low, b.low), _mm_sub_epi16(a.high, b.high) }; }
+    inline Lanes operator&(Lanes a, Lanes b) { return { _mm_and_si128(a.low, b.low), _mm_and_si128(a.high, b.high) }; }
+    inline Lanes max(Lanes a, Lanes b) { return { _mm_max_epi16(a.low, b.low), _mm_max_epi16(a.high, b.high) }; }
+    // SSE2 has no abs for 16 bit lanes
+    inline Lanes abs(Lanes a) { return max(a, splat(0) - a); }
+
+    // lane n gets lane n + 1, the last lane gets 0
+    inline Lanes next(Lanes a)
+    {
+        return { _mm_or_si128(_mm_srli_si128(a.low, 2), _mm_slli_si128(a.high, 14)), _mm_srli_si128(a.high, 2) };
+    }
+
+    inline int sum(Lanes a)
+    {
+        __m128i quads = _mm_add_epi32(_mm_madd_epi16(a.low, _mm_set1_epi16(1)), _mm_madd_epi16(a.high, _mm_set1_epi16(1)));
+        quads = _mm_add_epi32(quads, _mm_shuffle_epi32(quads, 0x4E));
+        quads = _mm_add_epi32(quads, _mm_shuffle_epi32(quads, 0xB1));
+        return _mm_cvtsi128_si32(quads);
+    }
+
+    inline int minimum(Lanes a)
+    {
+        __m128i m = _mm_min_epi16(a.low, a.high);
+        m = _mm_min_epi16(m, _mm_shuffle_epi32(m, 0x4E));
+        m = _mm_min_epi16(m, _mm_shuffle_epi32(m, 0xB1));
+        m = _mm_min_epi16(m, _mm_srli_epi32(m, 16));
+        return std::int16_t(_mm_cvtsi128_si32(m));
+    }
+
+    inline int maximum(Lanes a)
+    {
+        __m128i m = _mm_max_epi16(a.low, a.high);
+        m = _mm_max_epi16(m, _mm_shuffle_epi32(m, 0x4E));
+        m = _mm_max_epi16(m, _mm_shuffle_epi32(m, 0xB1));
+        m = _mm_max_epi16(m, _mm_srli_epi32(m, 16));
+        return std::int16_t(_mm_cvtsi128_si32(m));
+    }
+#elif defined(PLACEMENT_KERNEL_NEON)
+    struct Lanes
+    {
+        int16x8_t low;
+        int16x8_t high;
+    };
+
+    inline Lanes load(const std::int16_t* values) { return { vld1q_s16(values), vld1q_s16(values + 8) }; }
+    inline Lanes splat(int value) { return { vdupq_n_s16(std::int16_t(value)), vdupq_n_s16(std::int16_t(value)) }; }
+    inline Lanes operator+(Lanes a, Lanes b) { return { vaddq_s16(a.low, b.low), vaddq_s16(a.high, b.high) }; }
+    inline Lanes operator-(Lanes a, Lanes b) { return { vsubq_s16(a.low, b.low), vsubq_s16(a.high, b.high) }; }
+    inline Lanes operator&(Lanes a, Lanes b) { return { vandq_s16(a.low, b.low), vandq_s16(a.high, b.high) }; }
+    inline Lanes max(Lanes a, Lanes b) { return { vmaxq_s16(a.low, b.low), vmaxq_s16(a.high, b.high) }; }
+    inline Lanes abs(Lanes a) { return { vabsq_s16(a.low), vabsq_s16(a.high) }; }
+
+    // lane n gets lane n + 1, the last lane gets 0
+    inline Lanes next(Lanes a) { return { vextq_s16(a.low, a.high, 1), vextq_s16(a.high, vdupq_n_s16(0), 1) }; }
+
+    inline int sum(Lanes a) { return int(vaddlvq_s16(a.low) + vaddlvq_s16(a.high)); }
+    inline int minimum(Lanes a) { return vminvq_s16(vminq_s16(a.low, a.high)); }
+    inline int maximum(Lanes a) { return vmaxvq_s16(vmaxq_s16(a.low, a.high)); }
+#else
+    struct Lanes
+    {
+        std::array<std::int16_t, NUM_LANES> v;
+    };
+
+    template <typename Op>
+    inline Lanes apply(Lanes a, Lanes b, Op op)
+    {
+        Lanes result;
+        for (int lane = 0; lane < NUM_LANES; lane++)
+        {
+            result.v[lane] = std::int16_t(op(a.v[lane], b.v[lane]));
+        }
+        return result;
+    }
+
+    inline Lanes load(const std::int16_t* values)
+    {
+        Lanes result;
+        std::copy(values, values + NUM_LANES, result.v.begin());
+        return result;
+    }
+    inline Lanes splat(int value)
+    {
+        Lanes result;
+        result.v.fill(std::int16_t(value));
+        return result;
+    }
+    inline Lanes operator+(Lanes a, Lanes b) { return apply(a, b, [](int x, int y) { return x + y; }); }
+    inline Lanes operator-(Lanes a, Lanes b) { return apply(a, b, [](int x, int y) { return x - y; }); }
+    inline Lanes operator&(Lanes a, Lanes b) { return apply(a, b, [](int x, int y) { return x & y; }); }
+    inline Lanes max(Lanes a, Lanes b) { return apply(a, b, [](int x, int y) { return std::max(x, y); }); }
+    inline Lanes abs(Lanes a) { return apply(a, a, [](int x, int) { return x < 0 ? -x : x; }); }
+
+    // lane n gets lane n + 1, the last lane gets 0
+    inline Lanes next(Lanes a)
+    {
+        Lanes result;
+        for (int lane = 0; lane + 1 < NUM_LANES; lane++)
+        {
+            result.v[lane] = a.v[lane + 1];
+        }
+        result.v[NUM_LANES - 1] = 0;
+        return result;
+    }
+
+    inline int sum(Lanes a)
+    {
+        int result = 0;
+        for (std::int16_t value : a.v)
+        {
+            result += value;
+        }
+        return result;
+    }
+    inline int minimum(Lanes a) { return *std::min_element(a.v.begin(), a.v.end()); }
+    inline int maximum(Lanes a) { return *std::max_element(a.v.begin(), a.v.end()); }
+#endif
+
+    // far enough out of range that a lane holding it never wins a min or max
+    constexpr std::int16_t FAR = 1000;
+
+    // per column facts about one orientation, laid out so loading 16 lanes
+    // starting at (NUM_LANES - col) lines the piece up with board column col
+    struct OrientationLanes
+    {
+        // lowest subRow of the piece in each column
+        std::array<std::int16_t, 2 * NUM_LANES> bottoms;
+        // highest subRow of the piece in each column
+        std::array<std::int16_t, 2 * NUM_LANES> tops;
+        // all ones in the columns the piece covers
+        std::array<std::int16_t, 2 * NUM_LANES> covered;
+    };
+
+    OrientationLanes makeOrientationLanes(const PieceOrientation& orientation)
+    {
+        OrientationLanes result;
+        result.bottoms.fill(-FAR);
+        result.tops.fill(FAR);
+        result.covered.fill(0);
+        for (int subCol = 0; subCol < orientation.width; subCol++)
+        {
+            result.bottoms[NUM_LANES + subCol] = std::int16_t(Piece::bottomSubRow(orientation.tiles, subCol));
+            for (int subRow = 0; subRow < orientation.height; subRow++)
+            {
+                if (orientation.tiles & Piece::tileBit(subRow, subCol))
+                {
+                    result.tops[NUM_LANES + subCol] = std::int16_t(subRow);
+                    break;
+                }
+            }
+            result.covered[NUM_LANES + subCol] = -1;
+        }
+        return result;
+    }
+
+    unsigned shiftedRowBits(PieceMask tiles, int subRow, int col)
+    {
+        return unsigned(Piece::rowBits(tiles, subRow)) << col;
+    }
+
+    int countHoles(const StackRows& rows)
+    {
+        int holes = 0;
+        unsigned above = 0;
+        for (Board::RowMaskType row : rows)
+        {
+            unsigned holesInRow = above & ~unsigned(row) & Board::FULL_ROW_MASK;
+            for (; holesInRow != 0; holesInRow &= holesInRow - 1)
+            {
+                holes++;
+            }
+            above |= row;
+        }
+        return holes;
+    }
+
+    // closes up the full rows of a stack the naive way, everything above a full row moves down by one
+    void collapseStack(StackRows& rows)
+    {
+        int writeRow = Board::NUM_ROWS - 1;
+        for (int readRow = Board::NUM_ROWS - 1; readRow >= 0; readRow--)
+        {
+            if (rows[readRow] != Board::FULL_ROW_MASK)
+            {
+                rows[writeRow--] = rows[readRow];
+            }
+        }
+        for (; writeRow >= 0; writeRow--)
+        {
+            rows[writeRow] = 0;
+        }
+    }
+
+    // the slow and exact way, only taken when a placement clears rows
+    void measureClearedStack(StackRows rows, Placement& placement)
+    {
+        collapseStack(rows);
+        StackHeights heights;
+        measureHeights(rows, heights);
+
+        placement.aggregateHeight = 0;
+        placement.bumpiness = 0;
+        placement.maxHeight = 0;
+        for (int col = 0; col < Board::NUM_COLS; col++)
+        {
+            placement.aggregateHeight += heights[col];
+            placement.maxHeight = std::max(placement.maxHeight, heights[col]);
+            if (col + 1 < Board::NUM_COLS)
+            {
+                placement.bumpiness += std::abs(heights[col] - heights[col + 1]);
+            }
+        }
+        placement.holes = countHoles(rows);
+    }
+}
+
+StackRows lockedStack(const Board& board)
+{
+    StackRows stack = board.rowMasks;
+    const Piece* active = board.getActivePiece();
+    if (active && active->onBoard)
+    {
+        for (int subRow = 0; subRow < Piece::MAX_HEIGHT; subRow++)
+        {
+            unsigned bits = Piece::rowBits(active->tiles, subRow);
+            if (bits != 0)
+            {
+                bits = active->col < 0 ? bits >> -active->col : bits << active->col;
+                stack[active->row + subRow] &= Board::RowMaskType(~bits);
+            }
+        }
+    }
+    return stack;
+}
+
+void applyPlacement(StackRows& stack, int shape, const Placement& placement)
+{
+    const PieceOrientation& orientation = DEFAULT_ROTATIONS[shape].orientations[placement.rotation];
+    for (int subRow = 0; subRow < orientation.height; subRow++)
+    {
+        stack[placement.row + subRow] |= Board::RowMaskType(shiftedRowBits(orientation.tiles, subRow, placement.col));
+    }
+
+    if (placement.rowsCleared > 0)
+    {
+        collapseStack(stack);
+    }
+}
+
+void measureHeights(const StackRows& stack, StackHeights& heights)
+{
+    heights.fill(0);
+    for (int col = 0; col < Board::NUM_COLS; col++)
+    {
+        for (int row = 0; row < Board::NUM_ROWS; row++)
+        {
+            if ((stack[row] >> col) & 1)
+            {
+                heights[col] = Board::NUM_ROWS - row;
+                break;
+            }
+        }
+    }
+}
+
+int evaluatePlacements(const Board& board, int shape, int fromRow, PlacementList& placements)
+{
+    // the stack as the placements see it, without the piece that is still falling
+    return evaluatePlacements(lockedStack(board), board.columnHeights, shape, fromRow, placements);
+}
+
+int evaluatePlacements(const StackRows& stack, const StackHeights& columnHeights, int shape, int fromRow, PlacementList& placements)
+{
+    std::array<std::int16_t, NUM_LANES> heightValues = { 0 };
+    std::array<std::int16_t, NUM_LANES> bumpinessValues = { 0 };
+    for (int col = 0; col < Board::NUM_COLS; col++)
+    {
+        heightValues[col] = std::int16_t(columnHeights[col]);
+        bumpinessValues[col] = col + 1 < Board::NUM_COLS ? -1 : 0;
+    }
+    const Lanes heights = load(heightValues.data());
+    // only neighbouring pairs inside the board count towards bumpiness
+    const Lanes bumpinessLanes = load(bumpinessValues.data());
+    // row of the first tile in each column, NUM_ROWS if it's empty
+    const Lanes surfaceRows = splat(Board::NUM_ROWS) - heights;
+    const int stackHoles = countHoles(stack);
+
+    const PieceRotations& rotations = DEFAULT_ROTATIONS[shape];
+    int numPlacements = 0;
+    for (int rotation = 0; rotation < rotations.numDistinct; rotation++)
+    {
+        const PieceOrientation& orientation = rotations.orientations[rotation];
+        const OrientationLanes lanes = makeOrientationLanes(orientation);
+
+        for (int col = 0; col + orientation.width <= Board::NUM_COLS; col++)
+        {
+            const int offset = NUM_LANES - col;
+            const Lanes bottoms = load(lanes.bottoms.data() + offset);
+            const Lanes covered = load(lanes.covered.data() + offset);
+
+            // how far down each column lets the piece go, the tightest one decides
+            const Lanes roomBelow = surfaceRows - splat(1) - bottoms;
+            const int row = minimum(roomBelow);
+            if (row < 0 || row < fromRow)
+            {
+                // no room to drop it in, or it would have to come up through the stack
+                continue;
+            }
+
+            const Lanes pieceHeights = splat(Board::NUM_ROWS - row) - load(lanes.tops.data() + offset);
+            const Lanes newHeights = max(heights, pieceHeights);
+            // whatever is left between the piece and the old surface is now covered up
+            const Lanes newHoles = (roomBelow - splat(row)) & covered;
+
+            Placement& placement = placements[numPlacements++];
+            placement.rotation = rotation;
+            placement.col = col;
+            placement.row = row;
+            placement.rowsCleared = 0;
+            placement.aggregateHeight = sum(newHeights);
+            placement.holes = stackHoles + sum(newHoles);
+            placement.bumpiness = sum(abs(newHeights - next(newHeights)) & bumpinessLanes);
+            placement.maxHeight = maximum(newHeights);
+
+            for (int subRow = 0; subRow < orientation.height; subRow++)
+            {
+                placement.rowsCleared += (stack[row + subRow] | shiftedRowBits(orientation.tiles, subRow, col)) == Board::FULL_ROW_MASK;
+            }
+
+            if (placement.rowsCleared > 0)
+            {
+                StackRows placed = stack;
+                for (int subRow = 0; subRow < orientation.height; subRow++)
+                {
+                    placed[row + subRow] |= Board::RowMaskType(shiftedRowBits(orientation.tiles, subRow, col));
+                }
+                measureClearedStack(placed, placement);
+            }
+        }
+    }
+
+    return numPlacements;
+}
+
+const char* placementKernelName()
+{
+#if defined(PLACEMENT_KERNEL_AVX2)
+    return "avx2";
+#elif defined(PLACEMENT_KERNEL_SSE2)
+    return "sse2";
+#elif defined(PLACEMENT_KERNEL_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
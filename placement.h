@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+
+#include "board.h"
+
+// the board a placement leaves behind, after its full rows are cleared but
+// before any cascade, which is usually close enough to rank placements by
+struct Placement
+{
+    int rotation = 0;
+    int col = 0;
+    // landing row of the piece
+    int row = 0;
+    int rowsCleared = 0;
+    int aggregateHeight = 0;
+    // empty tiles with a tile somewhere above them in the same column
+    int holes = 0;
+    // sum of height differences between neighbouring columns
+    int bumpiness = 0;
+    int maxHeight = 0;
+};
+
+constexpr int MAX_PLACEMENTS = Piece::NUM_ROTATIONS * Board::NUM_COLS;
+using PlacementList = std::array<Placement, MAX_PLACEMENTS>;
+
+// the locked tiles placements are dropped onto, one row mask per board row, and how tall
+// each column of them is, so searches can look further ahead than the real board
+using StackRows = std::array<Board::RowMaskType, Board::NUM_ROWS>;
+using StackHeights = std::array<int, Board::NUM_COLS>;
+
+// scores every distinct rotation and column a piece of the given shape can be
+// hard dropped into from fromRow, ignoring the board's active piece
+// returns the number of placements written
+int evaluatePlacements(const Board& board, int shape, int fromRow, PlacementList& placements);
+int evaluatePlacements(const StackRows& stack, const StackHeights& heights, int shape, int fromRow, PlacementList& placements);
+
+// the board's tiles without the piece that is still falling
+StackRows lockedStack(const Board& board);
+// drops a placement's piece into the stack and clears the rows it fills, without any cascade
+void applyPlacement(StackRows& stack, int shape, const Placement& placement);
+void measureHeights(const StackRows& stack, StackHeights& heights);
+
+// the instruction set evaluatePlacements was built for
+const char* placementKernelName();
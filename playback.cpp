@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#include "replay.h"
+#include "simulation.h"
+
+// re-simulates recorded games headless, stepping ticks as fast as the simulation can take them
+
+namespace
+{
+    struct PlaybackResult
+    {
+        std::uint64_t inputs = 0;
+        // inputs left in the file after the game ended, a recording should have none
+        std::uint64_t trailingInputs = 0;
+    };
+
+    bool play(ReplayReader& reader, Simulation& simulation, PlaybackResult& result)
+    {
+        ReplayEvent event;
+        while (reader.next(event))
+        {
+            // gravity fires on the same ticks it did while recording
+            if (!simulation.advanceTo(event.tick) && event.input != ReplayInput::END)
+            {
+                result.trailingInputs++;
+                continue;
+            }
+
+            if (event.input != ReplayInput::END)
+            {
+                result.inputs++;
+                simulation.input(toDirection(event.input));
+            }
+        }
+        return !reader.isCorrupt();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <replay file>...\n", argv[0]);
+        return -1;
+    }
+
+    int failures = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        ReplayReader reader;
+        if (!reader.open(argv[i]))
+        {
+            std::fprintf(stderr, "%s: not a replay file\n", argv[i]);
+            failures++;
+            continue;
+        }
+
+        if (reader.ticksPerSecond != Simulation::TICKS_PER_SECOND)
+        {
+            std::fprintf(stderr, "%s: recorded at %d ticks a second, can only play %d\n",
+                argv[i], reader.ticksPerSecond, Simulation::TICKS_PER_SECOND);
+            failures++;
+            continue;
+        }
+
+        Simulation simulation(reader.seed, reader.mode, reader.startLevel);
+        PlaybackResult result;
+        auto start = std::chrono::steady_clock::now();
+        bool complete = play(reader, simulation, result);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%s\n", argv[i]);
+        std::printf("  seed:           %llu\n", (unsigned long long)reader.seed);
+        std::printf("  inputs:         %llu\n", (unsigned long long)result.inputs);
+        double gameSeconds = double(simulation.tick) / Simulation::TICKS_PER_SECOND;
+        std::printf("  rows completed: %d\n", simulation.board.rowsCompleted);
+        std::printf("  level:          %d\n", simulation.level);
+        std::printf("  game over:      %s\n", simulation.gameOver ? "yes" : "no");
+        std::printf("  game seconds:   %.3f\n", gameSeconds);
+        std::printf("  replay seconds: %.6f\n", elapsed);
+        if (elapsed > 0)
+        {
+            std::printf("  speedup:        %.0fx\n", gameSeconds / elapsed);
+        }
+
+        if (!complete)
+        {
+            std::fprintf(stderr, "%s: truncated or corrupt after %llu inputs\n", argv[i], (unsigned long long)result.inputs);
+            failures++;
+        }
+        if (result.trailingInputs > 0)
+        {
+            std::fprintf(stderr, "%s: %llu inputs after game over, replay diverged from the recording\n",
+                argv[i], (unsigned long long)result.trailingInputs);
+            failures++;
+        }
+    }
+
+    return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,128 @@
+#include "profiler.h"
+
+#include <algorithm>
+
+namespace
+{
+    // a pair of readings taken at startup, to work out how fast Profiler::now ticks
+    struct Calibration
+    {
+        std::uint64_t start = Profiler::now();
+        std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    };
+
+    const Calibration calibration;
+
+    double ticksPerMicrosecond()
+    {
+        std::uint64_t ticks = Profiler::now() - calibration.start;
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - calibration.startTime);
+        if (elapsed.count() <= 0 || ticks == 0)
+        {
+            return 1000.0;
+        }
+        return double(ticks) * 1000.0 / double(elapsed.count());
+    }
+}
+
+const char* profileStageName(ProfileStage stage)
+{
+    switch (stage)
+    {
+    case ProfileStage::BOARD_UPDATE:
+        return "UPDATE";
+    case ProfileStage::COLLAPSE_FULL_ROWS:
+        return "COLLAPSE";
+    case ProfileStage::PIECE_MOVE_TO:
+        return "MOVETO";
+    case ProfileStage::RENDER:
+        return "RENDER";
+    case ProfileStage::PRESENT:
+        return "PRESENT";
+    }
+    return "";
+}
+
+StageTiming Profiler::timing(ProfileStage stage) const
+{
+    const Samples& samples = stages[int(stage)];
+    std::array<std::uint32_t, SAMPLES_PER_STAGE> sorted;
+    int count = int(std::min<std::uint32_t>(samples.count.load(std::memory_order_relaxed), SAMPLES_PER_STAGE));
+    for (int i = 0; i < count; i++)
+    {
+        sorted[i] = samples.elapsed[i].load(std::memory_order_relaxed);
+    }
+
+    StageTiming result;
+    result.samples = count;
+    if (count == 0)
+    {
+        return result;
+    }
+
+    double scale = 1.0 / ticksPerMicrosecond();
+    auto percentile = [&](int percent)
+    {
+        auto nth = sorted.begin() + (count - 1) * percent / 100;
+        std::nth_element(sorted.begin(), nth, sorted.begin() + count);
+        return *nth * scale;
+    };
+    result.p50Microseconds = percentile(50);
+    result.p99Microseconds = percentile(99);
+    return result;
+}
+
+ProfileLog::~ProfileLog()
+{
+    close();
+}
+
+bool ProfileLog::open(const char* path, std::chrono::milliseconds interval)
+{
+    close();
+    file = std::fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    this->interval = interval;
+    start = Clock::now();
+    nextWrite = start + interval;
+    return true;
+}
+
+void ProfileLog::update()
+{
+    Clock::time_point now = Clock::now();
+    if (file && now >= nextWrite)
+    {
+        write(now);
+        nextWrite = now + interval;
+    }
+}
+
+void ProfileLog::close()
+{
+    if (!file)
+    {
+        return;
+    }
+
+    // the last stretch of the game is usually the interesting one
+    write(Clock::now());
+    std::fclose(file);
+    file = nullptr;
+}
+
+void ProfileLog::write(Clock::time_point now)
+{
+    double seconds = std::chrono::duration<double>(now - start).count();
+    for (int stage = 0; stage < NUM_PROFILE_STAGES; stage++)
+    {
+        StageTiming timing = profiler.timing(ProfileStage(stage));
+        std::fprintf(file, "%.1f %s %d %.2f %.2f\n", seconds, profileStageName(ProfileStage(stage)),
+            timing.samples, timing.p50Microseconds, timing.p99Microseconds);
+    }
+    std::fflush(file);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// scoped timers over the hot paths, kept in a ring buffer per stage so the game can
+// show and log percentiles of the latest samples. The timers cost a branch until
+// Profiler::setEnabled turns them on, and build with TETRIS_NO_PROFILING to compile
+// them out altogether, e.g. for release builds.
+//
+// the timers only need profiler.h, so headless tools don't have to link profiler.cpp
+// unless they read the timings back
+
+enum class ProfileStage
+{
+    BOARD_UPDATE,
+    COLLAPSE_FULL_ROWS,
+    PIECE_MOVE_TO,
+    // building and submitting a frame, present included
+    RENDER,
+    PRESENT
+};
+
+constexpr int NUM_PROFILE_STAGES = int(ProfileStage::PRESENT) + 1;
+
+// short and upper case, so it can be drawn with the overlay font
+const char* profileStageName(ProfileStage stage);
+
+struct StageTiming
+{
+    // samples behind the percentiles, at most Profiler::SAMPLES_PER_STAGE
+    int samples = 0;
+    double p50Microseconds = 0;
+    double p99Microseconds = 0;
+};
+
+class Profiler
+{
+public:
+    static constexpr int SAMPLES_PER_STAGE = 1024;
+
+    // cycles where the time stamp counter is available, nanoseconds elsewhere
+    static std::uint64_t now()
+    {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+
+    // each stage is expected to be timed from one thread, samples from two threads at
+    // once can overwrite each other but are never torn
+    void record(ProfileStage stage, std::uint64_t elapsed)
+    {
+        Samples& samples = stages[int(stage)];
+        std::uint32_t count = samples.count.load(std::memory_order_relaxed);
+        samples.elapsed[count % SAMPLES_PER_STAGE].store(std::uint32_t(elapsed < UINT32_MAX ? elapsed : UINT32_MAX),
+            std::memory_order_relaxed);
+        samples.count.store(count + 1, std::memory_order_relaxed);
+    }
+
+    // percentiles of the latest samples, safe to call while other threads record
+    StageTiming timing(ProfileStage stage) const;
+private:
+    // a cache line each, so stages timed on different threads don't contend
+    struct alignas(64) Samples
+    {
+        std::atomic<std::uint32_t> count;
+        std::array<std::atomic<std::uint32_t>, SAMPLES_PER_STAGE> elapsed;
+    };
+
+    std::atomic<bool> enabled;
+    std::array<Samples, NUM_PROFILE_STAGES> stages;
+};
+
+// zero initialized before anything runs, so timers in static constructors are fine too
+inline Profiler profiler;
+
+// records the time from construction to the end of the scope, if the profiler was enabled
+// when the scope started
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(ProfileStage stage) : stage(stage), timing(profiler.isEnabled())
+    {
+        if (timing)
+        {
+            start = Profiler::now();
+        }
+    }
+
+    ~ScopedTimer()
+    {
+        if (timing)
+        {
+            profiler.record(stage, Profiler::now() - start);
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+private:
+    ProfileStage stage;
+    bool timing;
+    std::uint64_t start = 0;
+};
+
+#if defined(TETRIS_NO_PROFILING)
+#define PROFILE_SCOPE(stage)
+#else
+#define PROFILE_SCOPE(stage) ScopedTimer profileScope(stage)
+#endif
+
+// appends the timings of every stage to a text file every so often, one line per stage:
+//   seconds stage samples p50 p99, in microseconds
+class ProfileLog
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ProfileLog() = default;
+    ProfileLog(const ProfileLog&) = delete;
+    ProfileLog& operator=(const ProfileLog&) = delete;
+    ~ProfileLog();
+
+    // returns false if the file can't be created
+    bool open(const char* path, std::chrono::milliseconds interval = std::chrono::seconds(5));
+    bool isOpen() const { return file != nullptr; }
+    // writes the timings if an interval has passed since the last time
+    void update();
+    void close();
+private:
+    std::FILE* file = nullptr;
+    std::chrono::milliseconds interval{ 0 };
+    Clock::time_point start;
+    Clock::time_point nextWrite;
+
+    void write(Clock::time_point now);
+};
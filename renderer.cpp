@@ -0,0 +1,712 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+namespace
+{
+    // tiles of a row that were added, removed or recolored between two sets of masks and colors
+    Board::RowMaskType changedTiles(Board::RowMaskType before, const std::array<std::uint8_t, Board::NUM_COLS>& beforeColors,
+        Board::RowMaskType after, const std::array<std::uint8_t, Board::NUM_COLS>& afterColors)
+    {
+        Board::RowMaskType changed = before ^ after;
+
+        // a tile can stay occupied but change color, e.g. when another piece settles into it
+        Board::RowMaskType kept = before & after;
+        if (kept != 0 && beforeColors != afterColors)
+        {
+            for (int col = 0; kept != 0; col++, kept >>= 1)
+            {
+                if ((kept & 1) && beforeColors[col] != afterColors[col])
+                {
+                    changed |= Board::RowMaskType(1u << col);
+                }
+            }
+        }
+        return changed;
+    }
+
+    constexpr Color ghostColor(int colorIndex)
+    {
+        Color pieceColor = DEFAULT_COLORS[colorIndex];
+        return { pieceColor.red / 4, pieceColor.green / 4, pieceColor.blue / 4, pieceColor.alpha };
+    }
+
+    using AtlasPixels = std::array<std::uint8_t, AtlasBoardRenderer::ATLAS_SIZE>;
+
+    // sprites side by side in one row, baked from the palette by the compiler, so startup
+    // uploads them straight out of the executable
+    constexpr AtlasPixels bakeAtlas()
+    {
+        AtlasPixels pixels = {};
+        for (int sprite = 0; sprite < AtlasBoardRenderer::NUM_SPRITES; sprite++)
+        {
+            Color color = BLACK;
+            if (sprite < AtlasBoardRenderer::GHOST_SPRITE)
+            {
+                color = DEFAULT_COLORS[sprite];
+            }
+            else if (sprite < AtlasBoardRenderer::BACKGROUND_SPRITE)
+            {
+                color = ghostColor(sprite - AtlasBoardRenderer::GHOST_SPRITE);
+            }
+
+            for (int y = 0; y < TILE_HEIGHT; y++)
+            {
+                for (int x = 0; x < TILE_WIDTH; x++)
+                {
+                    std::size_t pixel = std::size_t(y) * AtlasBoardRenderer::ATLAS_PITCH + std::size_t(sprite * TILE_WIDTH + x) * 4;
+                    pixels[pixel] = std::uint8_t(color.red);
+                    pixels[pixel + 1] = std::uint8_t(color.green);
+                    pixels[pixel + 2] = std::uint8_t(color.blue);
+                    pixels[pixel + 3] = std::uint8_t(color.alpha);
+                }
+            }
+        }
+        return pixels;
+    }
+
+    constexpr AtlasPixels DEFAULT_ATLAS = bakeAtlas();
+
+    // 3x5 glyphs, a row of 3 bits per line from the top with the leftmost pixel highest,
+    // anything missing draws as a space
+    std::uint16_t glyph(char c)
+    {
+        switch (c)
+        {
+        case '0': return 0b111'101'101'101'111;
+        case '1': return 0b010'110'010'010'111;
+        case '2': return 0b111'001'111'100'111;
+        case '3': return 0b111'001'111'001'111;
+        case '4': return 0b101'101'111'001'001;
+        case '5': return 0b111'100'111'001'111;
+        case '6': return 0b111'100'111'101'111;
+        case '7': return 0b111'001'001'001'001;
+        case '8': return 0b111'101'111'101'111;
+        case '9': return 0b111'101'111'001'111;
+        case '.': return 0b000'000'000'000'010;
+        case 'A': return 0b010'101'111'101'101;
+        case 'C': return 0b011'100'100'100'011;
+        case 'D': return 0b110'101'101'101'110;
+        case 'E': return 0b111'100'110'100'111;
+        case 'G': return 0b011'100'101'101'011;
+        case 'L': return 0b100'100'100'100'111;
+        case 'M': return 0b101'111'111'101'101;
+        case 'N': return 0b110'101'101'101'101;
+        case 'O': return 0b010'101'101'101'010;
+        case 'P': return 0b110'101'110'100'100;
+        case 'R': return 0b110'101'110'101'101;
+        case 'S': return 0b011'100'010'001'110;
+        case 'T': return 0b111'010'010'010'010;
+        case 'U': return 0b101'101'101'101'111;
+        case 'V': return 0b101'101'101'101'010;
+        default: return 0;
+        }
+    }
+}
+
+BoardGrid::BoardGrid(int numBoards, int outputWidth, int outputHeight)
+{
+    numBoards = std::max(1, numBoards);
+    double bestFit = 0;
+    int bestEmpty = 0;
+    for (int tryColumns = 1; tryColumns <= numBoards; tryColumns++)
+    {
+        int tryRows = (numBoards + tryColumns - 1) / tryColumns;
+        double fit = std::min(double(outputWidth) / (tryColumns * CELL_WIDTH), double(outputHeight) / (tryRows * CELL_HEIGHT));
+        int empty = tryColumns * tryRows - numBoards;
+        if (tryColumns == 1 || fit > bestFit || (fit == bestFit && empty < bestEmpty))
+        {
+            columns = tryColumns;
+            rows = tryRows;
+            bestFit = fit;
+            bestEmpty = empty;
+        }
+    }
+}
+
+void minimumOutputSize(int numBoards, int& width, int& height)
+{
+    width = SCREEN_WIDTH;
+    height = SCREEN_HEIGHT;
+    if (numBoards > 1)
+    {
+        BoardGrid grid(numBoards, 1920, 1080);
+        width = std::max(width, grid.width());
+        height = std::max(height, grid.height());
+    }
+}
+
+BoardLayout::BoardLayout(int outputWidth, int outputHeight)
+{
+    place(outputWidth, outputHeight, SCREEN_WIDTH, SCREEN_HEIGHT, BOARD_START_X_PIXELS, BOARD_START_Y_PIXELS);
+}
+
+BoardLayout::BoardLayout(int outputWidth, int outputHeight, const BoardGrid& grid, int index)
+{
+    place(outputWidth, outputHeight, grid.width(), grid.height(),
+        index % grid.columns * BoardGrid::CELL_WIDTH + 2 * TILE_WIDTH,
+        index / grid.columns * BoardGrid::CELL_HEIGHT + 2 * TILE_HEIGHT);
+}
+
+void BoardLayout::place(int outputWidth, int outputHeight, int areaWidth, int areaHeight, int boardX, int boardY)
+{
+    scale = std::max(1, std::min(outputWidth / areaWidth, outputHeight / areaHeight));
+    originX = std::max(0, (outputWidth - areaWidth * scale) / 2);
+    originY = std::max(0, (outputHeight - areaHeight * scale) / 2);
+    board = { x(boardX), y(boardY), BOARD_WIDTH_PIXELS * scale, BOARD_HEIGHT_PIXELS * scale };
+    outline = { board.x - 1, board.y - 1, board.w + 2, board.h + 2 };
+    for (int row = 0; row < Board::NUM_ROWS; row++)
+    {
+        for (int col = 0; col < Board::NUM_COLS; col++)
+        {
+            tiles[row][col] = { board.x + col * TILE_WIDTH * scale, board.y + row * TILE_HEIGHT * scale, TILE_WIDTH * scale, TILE_HEIGHT * scale };
+        }
+    }
+}
+
+ProfileOverlay::ProfileOverlay(SDL_Renderer* renderer) : renderer(renderer)
+{
+}
+
+void ProfileOverlay::draw(const BoardLayout& layout)
+{
+    if (Clock::now() >= nextRefresh)
+    {
+        refresh();
+        nextRefresh = Clock::now() + REFRESH_INTERVAL;
+    }
+
+    // every lit font pixel goes into one batch
+    int pixelSize = SCALE * layout.scale;
+    int numPixels = 0;
+    for (int line = 0; line < NUM_LINES; line++)
+    {
+        for (int i = 0; lines[line][i] != '\0'; i++)
+        {
+            std::uint16_t bits = glyph(lines[line][i]);
+            for (int y = 0; y < GLYPH_HEIGHT; y++)
+            {
+                for (int x = 0; x < GLYPH_WIDTH; x++)
+                {
+                    if ((bits >> ((GLYPH_HEIGHT - 1 - y) * GLYPH_WIDTH + (GLYPH_WIDTH - 1 - x))) & 1)
+                    {
+                        pixels[numPixels++] = {
+                            layout.x(START_X_PIXELS + (i * (GLYPH_WIDTH + 1) + x) * SCALE),
+                            layout.y(START_Y_PIXELS + (line * (GLYPH_HEIGHT + 2) + y) * SCALE),
+                            pixelSize, pixelSize };
+                    }
+                }
+            }
+        }
+    }
+
+    SDL_Rect background = { layout.x(START_X_PIXELS), layout.y(START_Y_PIXELS), WIDTH_PIXELS * layout.scale, HEIGHT_PIXELS * layout.scale };
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
+    SDL_RenderFillRect(renderer, &background);
+    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+    SDL_RenderFillRects(renderer, pixels.data(), numPixels);
+}
+
+void ProfileOverlay::refresh()
+{
+    std::snprintf(lines[0].data(), lines[0].size(), "%-8s %8s %8s", "US", "P50", "P99");
+    for (int stage = 0; stage < NUM_PROFILE_STAGES; stage++)
+    {
+        StageTiming timing = profiler.timing(ProfileStage(stage));
+        std::snprintf(lines[stage + 1].data(), lines[stage + 1].size(), "%-8s %8.2f %8.2f",
+            profileStageName(ProfileStage(stage)), timing.p50Microseconds, timing.p99Microseconds);
+    }
+}
+
+BoardRenderer::BoardRenderer(SDL_Renderer* renderer, int numBoards)
+    : renderer(renderer), layouts(std::size_t(std::max(1, numBoards))), outlines(layouts.size())
+{
+}
+
+void BoardRenderer::updateLayout()
+{
+    // in pixels rather than the window's size, which is in points on HiDPI displays
+    int width = SCREEN_WIDTH;
+    int height = SCREEN_HEIGHT;
+    if (SDL_GetRendererOutputSize(renderer, &width, &height) != 0)
+    {
+        width = SCREEN_WIDTH;
+        height = SCREEN_HEIGHT;
+    }
+
+    overlayLayout = BoardLayout(width, height);
+    if (layouts.size() == 1)
+    {
+        layouts[0] = overlayLayout;
+    }
+    else
+    {
+        BoardGrid grid(getNumBoards(), width, height);
+        for (int board = 0; board < getNumBoards(); board++)
+        {
+            layouts[board] = BoardLayout(width, height, grid, board);
+        }
+    }
+    invalidate();
+}
+
+void BoardRenderer::drawBorders()
+{
+    for (std::size_t board = 0; board < layouts.size(); board++)
+    {
+        outlines[board] = layouts[board].outline;
+    }
+    SDL_SetRenderDrawColor(renderer, 0x00, 0xFF, 0x00, 0xFF);
+    SDL_RenderDrawRects(renderer, outlines.data(), int(outlines.size()));
+}
+
+std::unique_ptr<BoardRenderer> createBoardRenderer(SDL_Renderer* renderer, RendererBackend backend, const std::uint8_t* atlasPixels, int numBoards)
+{
+    std::unique_ptr<BoardRenderer> boardRenderer;
+    switch (backend)
+    {
+    case RendererBackend::RECTS:
+        boardRenderer.reset(new RectBoardRenderer(renderer, numBoards));
+        break;
+    case RendererBackend::ATLAS:
+    {
+        std::unique_ptr<AtlasBoardRenderer> atlasRenderer(new AtlasBoardRenderer(renderer, numBoards));
+        if (!atlasRenderer->init(atlasPixels))
+        {
+            return nullptr;
+        }
+        boardRenderer.reset(atlasRenderer.release());
+        break;
+    }
+    }
+
+    if (boardRenderer)
+    {
+        boardRenderer->updateLayout();
+    }
+    return boardRenderer;
+}
+
+RectBoardRenderer::RectBoardRenderer(SDL_Renderer* renderer, int numBoards)
+    : BoardRenderer(renderer, numBoards), snapshots(layouts.size())
+{
+    for (std::vector<SDL_Rect>& batch : batches)
+    {
+        batch.reserve(snapshots.size() * Board::NUM_ROWS * Board::NUM_COLS);
+    }
+}
+
+void RectBoardRenderer::invalidate()
+{
+    dirty = true;
+}
+
+void RectBoardRenderer::update(const RenderSnapshot& next, int board)
+{
+    RenderSnapshot& snapshot = snapshots[board];
+    // a new piece can leave the ghost where it was but in a different color
+    dirty |= next.activeColorIndex != snapshot.activeColorIndex || next.ghostRows != snapshot.ghostRows;
+    for (int row = 0; row < Board::NUM_ROWS && !dirty; row++)
+    {
+        dirty = changedTiles(snapshot.rowMasks[row], snapshot.colorGrid[row], next.rowMasks[row], next.colorGrid[row]) != 0;
+    }
+    snapshot = next;
+}
+
+bool RectBoardRenderer::isDirty() const
+{
+    return dirty;
+}
+
+void RectBoardRenderer::present()
+{
+    if (!dirty)
+    {
+        return;
+    }
+
+    PROFILE_SCOPE(ProfileStage::RENDER);
+    for (std::size_t board = 0; board < snapshots.size(); board++)
+    {
+        const RenderSnapshot& snapshot = snapshots[board];
+        const BoardLayout& layout = layouts[board];
+        for (int row = 0; row < Board::NUM_ROWS; row++)
+        {
+            Board::RowMaskType filled = snapshot.rowMasks[row] | snapshot.ghostRows[row];
+            for (int col = 0; filled != 0; col++, filled >>= 1)
+            {
+                if (filled & 1)
+                {
+                    int batch = ((snapshot.rowMasks[row] >> col) & 1) ? snapshot.colorGrid[row][col]
+                        : GHOST_BATCH + snapshot.activeColorIndex;
+                    batches[batch].push_back(layout.tiles[row][col]);
+                }
+            }
+        }
+    }
+
+    SDL_SetRenderDrawColor(renderer, BLACK.red, BLACK.green, BLACK.blue, BLACK.alpha);
+    SDL_RenderClear(renderer);
+    drawBorders();
+    for (int batch = 0; batch < NUM_BATCHES; batch++)
+    {
+        if (batches[batch].empty())
+        {
+            continue;
+        }
+
+        Color color = batch < GHOST_BATCH ? DEFAULT_COLORS[batch] : ghostColor(batch - GHOST_BATCH);
+        SDL_SetRenderDrawColor(renderer, color.red, color.green, color.blue, color.alpha);
+        SDL_RenderFillRects(renderer, batches[batch].data(), int(batches[batch].size()));
+        batches[batch].clear();
+    }
+
+    if (overlay)
+    {
+        overlay->draw(overlayLayout);
+    }
+
+    {
+        PROFILE_SCOPE(ProfileStage::PRESENT);
+        SDL_RenderPresent(renderer);
+    }
+    dirty = false;
+}
+
+AtlasBoardRenderer::AtlasBoardRenderer(SDL_Renderer* renderer, int numBoards)
+    : BoardRenderer(renderer, numBoards), boards(layouts.size())
+{
+    int numStacks = int(boards.size());
+    sheetWidth = std::max(ATLAS_WIDTH, std::min(numStacks, STACKS_PER_ROW) * BOARD_WIDTH_PIXELS);
+    sheetHeight = ATLAS_HEIGHT + (numStacks + STACKS_PER_ROW - 1) / STACKS_PER_ROW * BOARD_HEIGHT_PIXELS;
+    for (int board = 0; board < numStacks; board++)
+    {
+        boards[board].stackX = board % STACKS_PER_ROW * BOARD_WIDTH_PIXELS;
+        boards[board].stackY = ATLAS_HEIGHT + board / STACKS_PER_ROW * BOARD_HEIGHT_PIXELS;
+    }
+
+    // no frame has more quads than there are tiles, a stack or its rows plus two pieces is far fewer
+    std::size_t maxQuads = boards.size() * Board::NUM_ROWS * Board::NUM_COLS;
+    vertices.reserve(maxQuads * 4);
+    indices.resize(maxQuads * 6);
+    for (std::size_t quad = 0; quad < maxQuads; quad++)
+    {
+        int first = int(quad * 4);
+        const int corners[] = { first, first + 1, first + 2, first + 2, first + 1, first + 3 };
+        std::copy(std::begin(corners), std::end(corners), indices.begin() + quad * 6);
+    }
+    flashes.reserve(boards.size() * Board::NUM_ROWS);
+}
+
+AtlasBoardRenderer::~AtlasBoardRenderer()
+{
+    if (atlas)
+    {
+        SDL_DestroyTexture(atlas);
+    }
+    if (sheet)
+    {
+        SDL_DestroyTexture(sheet);
+    }
+}
+
+bool AtlasBoardRenderer::init(const std::uint8_t* pixels)
+{
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) != 0 || !(info.flags & SDL_RENDERER_TARGETTEXTURE))
+    {
+        return false;
+    }
+
+    // the boards are drawn at one texel per layout pixel whatever the window's size, and copied
+    // up to the layout's scale by the GPU. Nearest sampling keeps the tile edges sharp
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+
+    atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, ATLAS_WIDTH, ATLAS_HEIGHT);
+    sheet = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, sheetWidth, sheetHeight);
+    if (!atlas || !sheet)
+    {
+        return false;
+    }
+
+    if (SDL_UpdateTexture(atlas, nullptr, pixels ? pixels : DEFAULT_ATLAS.data(), ATLAS_PITCH) != 0)
+    {
+        return false;
+    }
+
+    // the stacks are copied over the board background, so they can't blend
+    SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_NONE);
+    SDL_SetTextureBlendMode(sheet, SDL_BLENDMODE_NONE);
+    invalidate();
+    return true;
+}
+
+void AtlasBoardRenderer::invalidate()
+{
+    // render targets can lose their contents, e.g. when the device is reset
+    for (DrawnBoard& board : boards)
+    {
+        board.staleStackRows.fill(Board::FULL_ROW_MASK);
+    }
+    spritesStale = true;
+    frameDirty = true;
+}
+
+void AtlasBoardRenderer::update(const RenderSnapshot& next, int board)
+{
+    DrawnBoard& drawn = boards[board];
+    const RenderSnapshot& snapshot = drawn.snapshot;
+    // ticks only go back when the slot has a new game, e.g. a bot's board starting over, whose
+    // clears count from 0 again and have nothing to do with the last one's animation
+    if (next.tick < snapshot.tick)
+    {
+        drawn.staleStackRows.fill(Board::FULL_ROW_MASK);
+        drawn.animatingClear = false;
+        drawn.snapshot.clearSequence = next.clearSequence;
+        frameDirty = true;
+    }
+    for (int row = 0; row < Board::NUM_ROWS; row++)
+    {
+        Board::RowMaskType stackBefore = snapshot.rowMasks[row] & ~snapshot.activeRows[row];
+        Board::RowMaskType stackAfter = next.rowMasks[row] & ~next.activeRows[row];
+        drawn.staleStackRows[row] |= changedTiles(stackBefore, snapshot.colorGrid[row], stackAfter, next.colorGrid[row]);
+    }
+
+    frameDirty |= next.activeRows != snapshot.activeRows
+        || next.ghostRows != snapshot.ghostRows
+        || next.activeColorIndex != snapshot.activeColorIndex;
+    // a rollback can take the count back to a clear that's already been shown
+    if (std::int32_t(next.clearSequence - snapshot.clearSequence) > 0 && next.clearedRows != 0)
+    {
+        startClear(drawn, next.clearedRows);
+    }
+    drawn.snapshot = next;
+}
+
+bool AtlasBoardRenderer::isDirty() const
+{
+    if (frameDirty)
+    {
+        return true;
+    }
+
+    for (const DrawnBoard& board : boards)
+    {
+        if (board.animatingClear)
+        {
+            return true;
+        }
+        for (Board::RowMaskType stale : board.staleStackRows)
+        {
+            if (stale != 0)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void AtlasBoardRenderer::present()
+{
+    if (!isDirty())
+    {
+        return;
+    }
+
+    PROFILE_SCOPE(ProfileStage::RENDER);
+    redrawStacks();
+
+    // the back buffer isn't kept between presents, so each frame is drawn whole: the borders,
+    // then for every board one copy of its stack and the ghost and the piece over it
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
+    SDL_RenderClear(renderer);
+    drawBorders();
+    Clock::time_point now = Clock::now();
+    for (std::size_t board = 0; board < boards.size(); board++)
+    {
+        DrawnBoard& drawn = boards[board];
+        const RenderSnapshot& snapshot = drawn.snapshot;
+        const BoardLayout& layout = layouts[board];
+        auto elapsed = now - drawn.clearStart;
+        drawn.animatingClear = drawn.animatingClear && elapsed < CLEAR_ANIMATION;
+        if (drawn.animatingClear)
+        {
+            addClear(drawn, layout, elapsed);
+        }
+        else
+        {
+            SDL_Rect stack = { drawn.stackX, drawn.stackY, BOARD_WIDTH_PIXELS, BOARD_HEIGHT_PIXELS };
+            addQuad(stack, sheetWidth, sheetHeight, { float(layout.board.x), float(layout.board.y), float(layout.board.w), float(layout.board.h) });
+        }
+
+        SDL_Rect ghostSprite = spriteRect(GHOST_SPRITE + snapshot.activeColorIndex);
+        SDL_Rect activeSprite = spriteRect(snapshot.activeColorIndex);
+        for (int row = 0; row < Board::NUM_ROWS; row++)
+        {
+            Board::RowMaskType ghost = snapshot.ghostRows[row] & ~snapshot.rowMasks[row];
+            Board::RowMaskType active = snapshot.activeRows[row];
+            for (int col = 0; (ghost | active) != 0; col++, ghost >>= 1, active >>= 1)
+            {
+                if ((ghost | active) & 1)
+                {
+                    const SDL_Rect& tile = layout.tiles[row][col];
+                    addQuad((active & 1) ? activeSprite : ghostSprite, sheetWidth, sheetHeight,
+                        { float(tile.x), float(tile.y), float(tile.w), float(tile.h) });
+                }
+            }
+        }
+    }
+
+    // the flashing rows are never under a quad, so they can go first
+    if (!flashes.empty())
+    {
+        SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+        SDL_RenderFillRects(renderer, flashes.data(), int(flashes.size()));
+        flashes.clear();
+    }
+    drawQuads(sheet);
+
+    if (overlay)
+    {
+        overlay->draw(overlayLayout);
+    }
+
+    {
+        PROFILE_SCOPE(ProfileStage::PRESENT);
+        SDL_RenderPresent(renderer);
+    }
+    frameDirty = false;
+}
+
+SDL_Rect AtlasBoardRenderer::spriteRect(int sprite) const
+{
+    // the same in the atlas and along the top of the sheet
+    return { sprite * TILE_WIDTH, 0, TILE_WIDTH, TILE_HEIGHT };
+}
+
+void AtlasBoardRenderer::addQuad(const SDL_Rect& source, int textureWidth, int textureHeight, const SDL_FRect& target)
+{
+    float left = float(source.x) / float(textureWidth);
+    float right = float(source.x + source.w) / float(textureWidth);
+    float top = float(source.y) / float(textureHeight);
+    float bottom = float(source.y + source.h) / float(textureHeight);
+    SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+    vertices.push_back({ { target.x, target.y }, white, { left, top } });
+    vertices.push_back({ { target.x + target.w, target.y }, white, { right, top } });
+    vertices.push_back({ { target.x, target.y + target.h }, white, { left, bottom } });
+    vertices.push_back({ { target.x + target.w, target.y + target.h }, white, { right, bottom } });
+}
+
+void AtlasBoardRenderer::drawQuads(SDL_Texture* texture)
+{
+    if (vertices.empty())
+    {
+        return;
+    }
+
+    int numQuads = int(vertices.size() / 4);
+    SDL_RenderGeometry(renderer, texture, vertices.data(), int(vertices.size()), indices.data(), numQuads * 6);
+    vertices.clear();
+}
+
+void AtlasBoardRenderer::redrawStacks()
+{
+    bool anyStale = spritesStale;
+    for (const DrawnBoard& board : boards)
+    {
+        for (Board::RowMaskType stale : board.staleStackRows)
+        {
+            anyStale |= stale != 0;
+        }
+    }
+    if (!anyStale)
+    {
+        return;
+    }
+
+    // only tiles that changed are copied into the stacks, which is usually just a locked piece
+    // or the rows a clear moved, every board's in one call
+    SDL_SetRenderTarget(renderer, sheet);
+    if (spritesStale)
+    {
+        SDL_Rect sprites = { 0, 0, ATLAS_WIDTH, ATLAS_HEIGHT };
+        SDL_RenderCopy(renderer, atlas, nullptr, &sprites);
+        spritesStale = false;
+    }
+    for (DrawnBoard& board : boards)
+    {
+        const RenderSnapshot& snapshot = board.snapshot;
+        for (int row = 0; row < Board::NUM_ROWS; row++)
+        {
+            Board::RowMaskType stale = board.staleStackRows[row];
+            Board::RowMaskType locked = snapshot.rowMasks[row] & ~snapshot.activeRows[row];
+            for (int col = 0; stale != 0; col++, stale >>= 1)
+            {
+                if (stale & 1)
+                {
+                    int sprite = ((locked >> col) & 1) ? snapshot.colorGrid[row][col] : BACKGROUND_SPRITE;
+                    addQuad(spriteRect(sprite), ATLAS_WIDTH, ATLAS_HEIGHT,
+                        { float(board.stackX + col * TILE_WIDTH), float(board.stackY + row * TILE_HEIGHT), float(TILE_WIDTH), float(TILE_HEIGHT) });
+                }
+            }
+            board.staleStackRows[row] = 0;
+        }
+    }
+    drawQuads(atlas);
+    SDL_SetRenderTarget(renderer, nullptr);
+}
+
+void AtlasBoardRenderer::startClear(DrawnBoard& board, Board::RowSetType rows)
+{
+    board.animatingClear = true;
+    board.clearStart = Clock::now();
+    board.clearedRows = rows;
+
+    // as Board::compactRows moved them, counting up from the floor
+    board.clearShifts.fill(-1);
+    int newRow = Board::NUM_ROWS - 1;
+    for (int oldRow = Board::NUM_ROWS - 1; oldRow >= 0; oldRow--)
+    {
+        if (!((rows >> oldRow) & 1))
+        {
+            board.clearShifts[newRow] = newRow - oldRow;
+            newRow--;
+        }
+    }
+    frameDirty = true;
+}
+
+void AtlasBoardRenderer::addClear(const DrawnBoard& board, const BoardLayout& layout, Clock::duration elapsed)
+{
+    int rowHeight = TILE_HEIGHT * layout.scale;
+    float fallen = 0.0f;
+    if (elapsed < CLEAR_FLASH)
+    {
+        for (int row = 0; row < Board::NUM_ROWS; row++)
+        {
+            if ((board.clearedRows >> row) & 1)
+            {
+                flashes.push_back({ layout.board.x, layout.board.y + row * rowHeight, layout.board.w, rowHeight });
+            }
+        }
+    }
+    else
+    {
+        fallen = std::chrono::duration<float>(elapsed - CLEAR_FLASH) / std::chrono::duration<float>(CLEAR_ANIMATION - CLEAR_FLASH);
+    }
+
+    // the rows that came in empty are left as the cleared background
+    for (int row = 0; row < Board::NUM_ROWS; row++)
+    {
+        if (board.clearShifts[row] < 0)
+        {
+            continue;
+        }
+        SDL_Rect source = { board.stackX, board.stackY + row * TILE_HEIGHT, BOARD_WIDTH_PIXELS, TILE_HEIGHT };
+        int y = layout.board.y + row * rowHeight - int(float(board.clearShifts[row] * rowHeight) * (1.0f - fallen));
+        addQuad(source, sheetWidth, sheetHeight, { float(layout.board.x), float(y), float(layout.board.w), float(rowHeight) });
+    }
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <SDL.h>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "board.h"
+#include "profiler.h"
+#include "simulation.h"
+
+const int SCREEN_WIDTH = 640;
+const int SCREEN_HEIGHT = 480;
+const int TILE_WIDTH = 10;
+const int TILE_HEIGHT = 10;
+
+// where the board sits in a SCREEN_WIDTH x SCREEN_HEIGHT window, before any scaling
+constexpr int BOARD_START_X_PIXELS = SCREEN_WIDTH / 6;
+constexpr int BOARD_START_Y_PIXELS = SCREEN_HEIGHT / 6;
+constexpr int BOARD_WIDTH_PIXELS = Board::NUM_COLS * TILE_WIDTH;
+constexpr int BOARD_HEIGHT_PIXELS = Board::NUM_ROWS * TILE_HEIGHT;
+
+// how several boards share one output, in cells of a board with two tiles of margin all round
+struct BoardGrid
+{
+    static constexpr int CELL_WIDTH = BOARD_WIDTH_PIXELS + 4 * TILE_WIDTH;
+    static constexpr int CELL_HEIGHT = BOARD_HEIGHT_PIXELS + 4 * TILE_HEIGHT;
+
+    int columns = 1;
+    int rows = 1;
+
+    // the arrangement that draws the boards largest in an output of this size, of the ones
+    // that do equally well the one with the fewest empty cells
+    BoardGrid(int numBoards, int outputWidth, int outputHeight);
+
+    // in layout pixels
+    int width() const { return columns * CELL_WIDTH; }
+    int height() const { return rows * CELL_HEIGHT; }
+};
+
+// the smallest window numBoards can be drawn in without shrinking them, laid out for a 16:9
+// display but never smaller than SCREEN_WIDTH x SCREEN_HEIGHT
+void minimumOutputSize(int numBoards, int& width, int& height);
+
+// where everything goes in an output of some size, worked out when the size changes rather
+// than for every tile drawn
+//
+// the SCREEN_WIDTH x SCREEN_HEIGHT layout, or a grid's, is scaled up by the largest whole
+// number that fits and centered, so tiles stay square with sharp edges at any size or pixel
+// density, and the rest of the output is left black
+struct BoardLayout
+{
+    // output pixels per layout pixel
+    int scale = 1;
+    // where the scaled layout starts in the output
+    int originX = 0;
+    int originY = 0;
+    SDL_Rect board;
+    // one pixel outside the board all round, at any scale
+    SDL_Rect outline;
+    std::array<std::array<SDL_Rect, Board::NUM_COLS>, Board::NUM_ROWS> tiles;
+
+    explicit BoardLayout(int outputWidth = SCREEN_WIDTH, int outputHeight = SCREEN_HEIGHT);
+    // board index of a grid, in its cell counting across from the top left
+    BoardLayout(int outputWidth, int outputHeight, const BoardGrid& grid, int index);
+
+    // a point of the unscaled layout in output pixels
+    int x(int layoutX) const { return originX + layoutX * scale; }
+    int y(int layoutY) const { return originY + layoutY * scale; }
+private:
+    // fits an area of layout pixels to the output, with the board at a point of it
+    void place(int outputWidth, int outputHeight, int areaWidth, int areaHeight, int boardX, int boardY);
+};
+
+enum class RendererBackend
+{
+    // clears and fills every occupied and ghost tile each present, one SDL_RenderFillRects per color
+    RECTS,
+    // tile sprites copied out of one atlas texture, with the locked stack cached in a render target
+    ATLAS
+};
+
+// p50 and p99 of every profiled stage in a corner of the window, in a tiny bitmap font so
+// it needs no font library
+class ProfileOverlay
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // where the overlay and its black background go, right of the board
+    static constexpr int START_X_PIXELS = BOARD_START_X_PIXELS + BOARD_WIDTH_PIXELS + 4 * TILE_WIDTH;
+    static constexpr int START_Y_PIXELS = BOARD_START_Y_PIXELS;
+    // layout pixels per font pixel
+    static constexpr int SCALE = 2;
+    static constexpr int GLYPH_WIDTH = 3;
+    static constexpr int GLYPH_HEIGHT = 5;
+    static constexpr int MAX_LINE_LENGTH = 28;
+    static constexpr int NUM_LINES = NUM_PROFILE_STAGES + 1;
+    static constexpr int WIDTH_PIXELS = MAX_LINE_LENGTH * (GLYPH_WIDTH + 1) * SCALE;
+    static constexpr int HEIGHT_PIXELS = NUM_LINES * (GLYPH_HEIGHT + 2) * SCALE;
+
+    explicit ProfileOverlay(SDL_Renderer* renderer);
+
+    // draws over whatever is in the overlay's corner, call before presenting
+    void draw(const BoardLayout& layout);
+private:
+    // sorting the samples every frame would show up in the timings it draws
+    static constexpr std::chrono::milliseconds REFRESH_INTERVAL{ 250 };
+
+    SDL_Renderer* renderer;
+    std::array<std::array<char, MAX_LINE_LENGTH + 1>, NUM_LINES> lines = {};
+    Clock::time_point nextRefresh;
+    std::array<SDL_Rect, NUM_LINES * MAX_LINE_LENGTH * GLYPH_WIDTH * GLYPH_HEIGHT> pixels;
+
+    void refresh();
+};
+
+// draws snapshots of one or more boards into a window, whatever the backend. However many
+// boards there are, a frame is one pass over all of them and a single SDL_RenderPresent
+class BoardRenderer
+{
+public:
+    // drawn on top of each frame when set
+    ProfileOverlay* overlay = nullptr;
+
+    virtual ~BoardRenderer() = default;
+
+    int getNumBoards() const { return int(layouts.size()); }
+    const BoardLayout& getLayout(int board = 0) const { return layouts[board]; }
+    // fits the layouts to the renderer's output and redraws everything, call when the window
+    // is resized or moves to a display of another pixel density
+    void updateLayout();
+
+    // marks every board for redrawing, e.g. for the first frame or after the window lost its contents
+    virtual void invalidate() = 0;
+    // takes the snapshot of a board to draw next and works out what changed since its last one
+    virtual void update(const RenderSnapshot& snapshot, int board = 0) = 0;
+    // whether present has anything to draw
+    virtual bool isDirty() const = 0;
+    // draws every board and presents them together, does nothing if nothing changed
+    virtual void present() = 0;
+protected:
+    SDL_Renderer* renderer;
+    // one per board, a single board gets the SCREEN_WIDTH x SCREEN_HEIGHT layout and more a grid
+    std::vector<BoardLayout> layouts;
+    // where the overlay goes, the single board layout of the whole output
+    BoardLayout overlayLayout;
+
+    BoardRenderer(SDL_Renderer* renderer, int numBoards);
+
+    // the outline of every board in one call
+    void drawBorders();
+private:
+    std::vector<SDL_Rect> outlines;
+};
+
+// returns nullptr if the backend can't run on this renderer, the layouts start out fitted to its output.
+// The atlas backend draws from atlasPixels when given, see AtlasBoardRenderer::init
+std::unique_ptr<BoardRenderer> createBoardRenderer(SDL_Renderer* renderer, RendererBackend backend,
+    const std::uint8_t* atlasPixels = nullptr, int numBoards = 1);
+
+// redraws every board from scratch each frame, as the back buffer is undefined after a present,
+// batched so each color is a single SDL_RenderFillRects call across every board. The window is
+// cleared to the background color, so only occupied and ghost tiles are filled, and clears show
+// at once without animating
+class RectBoardRenderer : public BoardRenderer
+{
+public:
+    explicit RectBoardRenderer(SDL_Renderer* renderer, int numBoards = 1);
+    void invalidate() override;
+    void update(const RenderSnapshot& snapshot, int board = 0) override;
+    bool isDirty() const override;
+    void present() override;
+private:
+    // one batch per piece color, then one per ghost color
+    static constexpr int NUM_BATCHES = 2 * NUM_DEFAULT_COLORS;
+    static constexpr int GHOST_BATCH = NUM_DEFAULT_COLORS;
+
+    std::vector<RenderSnapshot> snapshots;
+    // a tile or the ghost changed since the last present, or the window needs a full redraw
+    bool dirty = true;
+    // room for every tile of every board, reserved up front
+    std::array<std::vector<SDL_Rect>, NUM_BATCHES> batches;
+};
+
+// every frame is one copy of each board's cached stack plus the ghost and active piece, so
+// the cost of a frame doesn't grow with the tile size or how full the boards are. The stacks
+// and a copy of the atlas share one render target, so the whole frame is a single
+// SDL_RenderGeometry call however many boards there are
+//
+// a clear is animated after the fact: the board has already compacted and the next piece is
+// in play, while the cleared rows flash where they were and the rows above fall into place,
+// drawn as strips of the stack texture, which already holds the board after the clear
+class AtlasBoardRenderer : public BoardRenderer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // sprites in the atlas, one per piece color, then one per ghost color, then the background
+    static constexpr int NUM_SPRITES = 2 * NUM_DEFAULT_COLORS + 1;
+    static constexpr int GHOST_SPRITE = NUM_DEFAULT_COLORS;
+    static constexpr int BACKGROUND_SPRITE = 2 * NUM_DEFAULT_COLORS;
+    // the cleared rows flash for CLEAR_FLASH, then the rows above them fall for the rest
+    static constexpr std::chrono::milliseconds CLEAR_ANIMATION{ 200 };
+    static constexpr std::chrono::milliseconds CLEAR_FLASH{ 80 };
+    // the atlas is RGBA32 rows of every sprite side by side, a tile each
+    static constexpr int ATLAS_WIDTH = NUM_SPRITES * TILE_WIDTH;
+    static constexpr int ATLAS_HEIGHT = TILE_HEIGHT;
+    static constexpr int ATLAS_PITCH = ATLAS_WIDTH * 4;
+    static constexpr std::size_t ATLAS_SIZE = std::size_t(ATLAS_PITCH) * ATLAS_HEIGHT;
+
+    // stacks in a row of the sheet texture, the rest go in rows below
+    static constexpr int STACKS_PER_ROW = 16;
+
+    explicit AtlasBoardRenderer(SDL_Renderer* renderer, int numBoards = 1);
+    ~AtlasBoardRenderer() override;
+    AtlasBoardRenderer(const AtlasBoardRenderer&) = delete;
+    AtlasBoardRenderer& operator=(const AtlasBoardRenderer&) = delete;
+
+    // uploads the atlas and creates the sheet texture, returns false if the renderer can't.
+    // The atlas is the one baked in from the palette unless pixels points at ATLAS_SIZE bytes
+    // of another, e.g. a mapped file, which only has to last until this returns
+    bool init(const std::uint8_t* pixels = nullptr);
+    void invalidate() override;
+    void update(const RenderSnapshot& snapshot, int board = 0) override;
+    bool isDirty() const override;
+    void present() override;
+private:
+    struct DrawnBoard
+    {
+        RenderSnapshot snapshot;
+        // tiles of the board's stack that no longer match the snapshot
+        std::array<Board::RowMaskType, Board::NUM_ROWS> staleStackRows = { 0 };
+        // where the board's stack is in the sheet
+        int stackX = 0;
+        int stackY = 0;
+
+        // the clear being animated, a new one cuts the last one short
+        bool animatingClear = false;
+        Clock::time_point clearStart;
+        Board::RowSetType clearedRows = 0;
+        // rows each row of the stack fell in the clear, -1 for the rows that came in empty at the top
+        std::array<int, Board::NUM_ROWS> clearShifts = { 0 };
+    };
+
+    // the sprites as uploaded, only ever copied into the sheet
+    SDL_Texture* atlas = nullptr;
+    // the atlas along the top and every board's locked tiles below it, drawn into as they change,
+    // at one pixel per layout pixel, the GPU scales them up as they're copied to the window
+    SDL_Texture* sheet = nullptr;
+    int sheetWidth = 0;
+    int sheetHeight = 0;
+    // the sheet's copy of the atlas has to be made again, render targets can lose their contents
+    bool spritesStale = true;
+    std::vector<DrawnBoard> boards;
+    // an active piece or ghost moved, or the window needs a full redraw
+    bool frameDirty = true;
+
+    // quads of one SDL_RenderGeometry call, room for every tile of every board is reserved up front
+    std::vector<SDL_Vertex> vertices;
+    // two triangles per quad, made once as they never change
+    std::vector<int> indices;
+    // the rows of every board flashing for a clear, filled in one call
+    std::vector<SDL_Rect> flashes;
+
+    SDL_Rect spriteRect(int sprite) const;
+    // copies source, in texels of a texture this size, to target
+    void addQuad(const SDL_Rect& source, int textureWidth, int textureHeight, const SDL_FRect& target);
+    // draws the quads added since the last call from one texture
+    void drawQuads(SDL_Texture* texture);
+    void redrawStacks();
+    void startClear(DrawnBoard& board, Board::RowSetType rows);
+    // the board's stack as it looks some way into its clear animation, added to the quads and flashes
+    void addClear(const DrawnBoard& board, const BoardLayout& layout, Clock::duration elapsed);
+};
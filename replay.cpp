@@ -0,0 +1,245 @@
+#include "replay.h"
+
+namespace
+{
+    constexpr std::uint8_t MAGIC[] = { 'T', 'R', 'P', 'L' };
+    constexpr int INPUT_BITS = 3;
+    constexpr std::uint64_t INPUT_MASK = (1u << INPUT_BITS) - 1;
+    constexpr int NUM_INPUTS = int(ReplayInput::END) + 1;
+}
+
+ReplayInput toReplayInput(Direction direction)
+{
+    switch (direction)
+    {
+    case Direction::UP:
+        return ReplayInput::UP;
+    case Direction::DOWN:
+        return ReplayInput::DOWN;
+    case Direction::LEFT:
+        return ReplayInput::LEFT;
+    case Direction::RIGHT:
+        return ReplayInput::RIGHT;
+    case Direction::DROP:
+        return ReplayInput::DROP;
+    }
+    return ReplayInput::DOWN;
+}
+
+Direction toDirection(ReplayInput input)
+{
+    switch (input)
+    {
+    case ReplayInput::UP:
+        return Direction::UP;
+    case ReplayInput::LEFT:
+        return Direction::LEFT;
+    case ReplayInput::RIGHT:
+        return Direction::RIGHT;
+    case ReplayInput::DROP:
+        return Direction::DROP;
+    case ReplayInput::DOWN:
+    case ReplayInput::END:
+        break;
+    }
+    return Direction::DOWN;
+}
+
+ReplayWriter::~ReplayWriter()
+{
+    close(lastTick);
+}
+
+bool ReplayWriter::open(const char* path, std::uint64_t seed, RandomizerMode mode, int startLevel)
+{
+    close(lastTick);
+    file = std::fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    size = 0;
+    lastTick = 0;
+    failed = false;
+    for (std::uint8_t byte : MAGIC)
+    {
+        buffer[size++] = byte;
+    }
+    writeVarint(VERSION);
+    writeVarint(seed);
+    writeVarint(std::uint64_t(mode));
+    writeVarint(std::uint64_t(startLevel));
+    writeVarint(Simulation::TICKS_PER_SECOND);
+    return true;
+}
+
+void ReplayWriter::record(std::uint64_t tick, ReplayInput input)
+{
+    if (!file)
+    {
+        return;
+    }
+
+    // inputs come a few hundred milliseconds apart, so most take two bytes
+    writeVarint(((tick - lastTick) << INPUT_BITS) | std::uint64_t(input));
+    lastTick = tick;
+}
+
+bool ReplayWriter::flush()
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    if (size > 0 && std::fwrite(buffer.data(), 1, size, file) != std::size_t(size))
+    {
+        failed = true;
+    }
+    size = 0;
+    return !failed && std::fflush(file) == 0;
+}
+
+bool ReplayWriter::close(std::uint64_t tick)
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    record(tick, ReplayInput::END);
+    bool success = flush();
+    success &= std::fclose(file) == 0;
+    file = nullptr;
+    return success;
+}
+
+void ReplayWriter::writeVarint(std::uint64_t value)
+{
+    if (size > BUFFER_SIZE - MAX_VARINT_BYTES)
+    {
+        flush();
+    }
+
+    while (value >= 0x80)
+    {
+        buffer[size++] = std::uint8_t(value | 0x80);
+        value >>= 7;
+    }
+    buffer[size++] = std::uint8_t(value);
+}
+
+ReplayReader::~ReplayReader()
+{
+    close();
+}
+
+bool ReplayReader::open(const char* path)
+{
+    close();
+    file = std::fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    size = 0;
+    position = 0;
+    tick = 0;
+    ended = false;
+    corrupt = false;
+    for (std::uint8_t expected : MAGIC)
+    {
+        if (readByte() != expected)
+        {
+            close();
+            return false;
+        }
+    }
+
+    std::uint64_t version;
+    std::uint64_t modeValue;
+    std::uint64_t levelValue;
+    std::uint64_t rateValue;
+    if (!readVarint(version) || version != ReplayWriter::VERSION
+        || !readVarint(seed)
+        || !readVarint(modeValue) || modeValue > std::uint64_t(RandomizerMode::BAG)
+        || !readVarint(levelValue) || levelValue < Simulation::MIN_LEVEL || levelValue > Simulation::MAX_LEVEL
+        || !readVarint(rateValue) || rateValue == 0 || rateValue > 1000000)
+    {
+        close();
+        return false;
+    }
+    mode = RandomizerMode(modeValue);
+    startLevel = int(levelValue);
+    ticksPerSecond = int(rateValue);
+    return true;
+}
+
+bool ReplayReader::next(ReplayEvent& event)
+{
+    std::uint64_t value;
+    if (!file || ended)
+    {
+        return false;
+    }
+
+    if (!readVarint(value) || (value & INPUT_MASK) >= std::uint64_t(NUM_INPUTS))
+    {
+        // a finished recording always ends with END
+        corrupt = true;
+        return false;
+    }
+
+    tick += value >> INPUT_BITS;
+    event.tick = tick;
+    event.input = ReplayInput(value & INPUT_MASK);
+    ended = event.input == ReplayInput::END;
+    return true;
+}
+
+void ReplayReader::close()
+{
+    if (file)
+    {
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+int ReplayReader::readByte()
+{
+    if (position == size)
+    {
+        size = int(std::fread(buffer.data(), 1, BUFFER_SIZE, file));
+        position = 0;
+        if (size == 0)
+        {
+            return -1;
+        }
+    }
+    return buffer[position++];
+}
+
+bool ReplayReader::readVarint(std::uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = readByte();
+        if (byte < 0)
+        {
+            return false;
+        }
+
+        value |= std::uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+
+    corrupt = true;
+    return false;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+#include "simulation.h"
+
+// a game is its seed and the tick each input arrived on, gravity follows from
+// the ticks, so replaying the inputs on a simulation with the same seed plays
+// the same game again
+//
+// file layout, all integers are LEB128 varints:
+//   "TRPL" version seed randomizerMode startLevel ticksPerSecond
+//   then one varint per input: (ticks since the previous input << 3) | input
+
+enum class ReplayInput : std::uint8_t
+{
+    UP,
+    DOWN,
+    LEFT,
+    RIGHT,
+    DROP,
+    // the tick the recording stopped on, always last
+    END
+};
+
+struct ReplayEvent
+{
+    // simulation tick the input was applied on
+    std::uint64_t tick = 0;
+    ReplayInput input = ReplayInput::END;
+};
+
+ReplayInput toReplayInput(Direction direction);
+Direction toDirection(ReplayInput input);
+
+// appends inputs to a replay file as they happen, through a small buffer
+class ReplayWriter
+{
+public:
+    static constexpr int VERSION = 2;
+
+    ReplayWriter() = default;
+    ReplayWriter(const ReplayWriter&) = delete;
+    ReplayWriter& operator=(const ReplayWriter&) = delete;
+    ~ReplayWriter();
+
+    // returns false if the file can't be created
+    bool open(const char* path, std::uint64_t seed, RandomizerMode mode = RandomizerMode::BAG,
+        int startLevel = Simulation::MIN_LEVEL);
+    bool isOpen() const { return file != nullptr; }
+    // ticks must not go backwards
+    void record(std::uint64_t tick, ReplayInput input);
+    // writes out anything buffered, returns false if any write failed
+    bool flush();
+    // records END on the given tick and closes the file
+    bool close(std::uint64_t tick);
+private:
+    static constexpr int BUFFER_SIZE = 4096;
+    // longest varint of a 64 bit value
+    static constexpr int MAX_VARINT_BYTES = 10;
+
+    std::FILE* file = nullptr;
+    std::array<std::uint8_t, BUFFER_SIZE> buffer;
+    int size = 0;
+    std::uint64_t lastTick = 0;
+    bool failed = false;
+
+    void writeVarint(std::uint64_t value);
+};
+
+// reads a replay file front to back one input at a time, never holding more than a buffer of it
+class ReplayReader
+{
+public:
+    std::uint64_t seed = 0;
+    RandomizerMode mode = RandomizerMode::BAG;
+    int startLevel = Simulation::MIN_LEVEL;
+    // playback has to tick at the same rate as the recording to play the same game
+    int ticksPerSecond = Simulation::TICKS_PER_SECOND;
+
+    ReplayReader() = default;
+    ReplayReader(const ReplayReader&) = delete;
+    ReplayReader& operator=(const ReplayReader&) = delete;
+    ~ReplayReader();
+
+    // reads the header, returns false if the file is missing or isn't a replay
+    bool open(const char* path);
+    // returns false after END, or if the file ends without one, which isCorrupt reports
+    bool next(ReplayEvent& event);
+    bool isCorrupt() const { return corrupt; }
+    void close();
+private:
+    static constexpr int BUFFER_SIZE = 1 << 16;
+
+    std::FILE* file = nullptr;
+    std::array<std::uint8_t, BUFFER_SIZE> buffer;
+    int size = 0;
+    int position = 0;
+    std::uint64_t tick = 0;
+    bool ended = false;
+    bool corrupt = false;
+
+    // returns -1 at the end of the file
+    int readByte();
+    // returns false at the end of the file, sets corrupt on a varint longer than 64 bits
+    bool readVarint(std::uint64_t& value);
+};
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "match_server.h"
+
+// hosts versus matches for clients started with --connect, on one shard per --threads
+
+namespace
+{
+    constexpr int DEFAULT_PORT = 7777;
+    constexpr int DEFAULT_MAX_MATCHES = 1024;
+    // players are only paired with others the kernel sent to the same shard, so with more than
+    // one, two players alone on the server usually never meet
+    constexpr int DEFAULT_SHARDS = 1;
+    constexpr std::chrono::seconds STATS_INTERVAL{ 5 };
+
+    std::atomic<bool> running{ true };
+
+    void stop(int)
+    {
+        running.store(false);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int port = DEFAULT_PORT;
+    int numShards = DEFAULT_SHARDS;
+    int maxMatches = DEFAULT_MAX_MATCHES;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+        {
+            port = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            numShards = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--max-matches") == 0 && i + 1 < argc)
+        {
+            maxMatches = std::atoi(argv[++i]);
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--port n] [--threads n] [--max-matches n]\n", argv[0]);
+            return -1;
+        }
+    }
+    numShards = std::max(numShards, 1);
+    maxMatches = std::max(maxMatches, numShards);
+
+    std::vector<std::unique_ptr<MatchShard>> shards;
+    for (int i = 0; i < numShards; i++)
+    {
+        shards.push_back(std::make_unique<MatchShard>((maxMatches + numShards - 1) / numShards));
+        if (!shards.back()->open(port))
+        {
+            std::fprintf(stderr, "couldn't open port %d\n", port);
+            return -2;
+        }
+    }
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    std::atomic<int> failures{ 0 };
+    std::vector<std::thread> threads;
+    for (auto& shard : shards)
+    {
+        threads.emplace_back([&shard, &failures]()
+        {
+            if (!shard->run(running))
+            {
+                failures++;
+                running.store(false);
+            }
+        });
+    }
+    std::printf("serving up to %d matches on port %d, %d shards\n", maxMatches, port, numShards);
+
+    std::uint64_t lastReceived = 0;
+    std::uint64_t lastSent = 0;
+    std::uint64_t lastTicks = 0;
+    auto nextStats = std::chrono::steady_clock::now() + STATS_INTERVAL;
+    while (running.load())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() < nextStats)
+        {
+            continue;
+        }
+        nextStats += STATS_INTERVAL;
+
+        std::uint64_t active = 0;
+        std::uint64_t finished = 0;
+        std::uint64_t drawn = 0;
+        std::uint64_t abandoned = 0;
+        std::uint64_t received = 0;
+        std::uint64_t sent = 0;
+        std::uint64_t ticks = 0;
+        for (const auto& shard : shards)
+        {
+            const ShardStats& stats = shard->stats;
+            active += stats.activeMatches.load(std::memory_order_relaxed);
+            finished += stats.finishedMatches.load(std::memory_order_relaxed);
+            drawn += stats.drawnMatches.load(std::memory_order_relaxed);
+            abandoned += stats.abandonedMatches.load(std::memory_order_relaxed);
+            received += stats.packetsReceived.load(std::memory_order_relaxed);
+            sent += stats.packetsSent.load(std::memory_order_relaxed);
+            ticks += stats.ticksSimulated.load(std::memory_order_relaxed);
+        }
+        double seconds = std::chrono::duration<double>(STATS_INTERVAL).count();
+        std::printf("matches %llu active, %llu finished (%llu drawn), %llu abandoned | packets/s %.0f in, %.0f out | ticks/s %.0f\n",
+            (unsigned long long)active, (unsigned long long)finished, (unsigned long long)drawn, (unsigned long long)abandoned,
+            (received - lastReceived) / seconds, (sent - lastSent) / seconds, (ticks - lastTicks) / seconds);
+        std::fflush(stdout);
+        lastReceived = received;
+        lastSent = sent;
+        lastTicks = ticks;
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    return failures ? -3 : 0;
+}
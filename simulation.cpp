@@ -0,0 +1,157 @@
+#include "simulation.h"
+
+Simulation::Simulation(std::uint64_t seed, RandomizerMode mode, int startLevel)
+    : board(seed, mode)
+{
+    if (startLevel < MIN_LEVEL)
+    {
+        startLevel = MIN_LEVEL;
+    }
+    else if (startLevel > MAX_LEVEL)
+    {
+        startLevel = MAX_LEVEL;
+    }
+    this->startLevel = startLevel;
+    updateLevel();
+}
+
+bool Simulation::input(Direction direction)
+{
+    if (gameOver)
+    {
+        return false;
+    }
+
+    PieceHandle piece = board.activePiece;
+    gameOver = !board.update(direction);
+    if (board.activePiece.index != piece.index || board.activePiece.generation != piece.generation)
+    {
+        // a new piece starts falling from the top of its row
+        gravityProgress = 0;
+        updateLevel();
+    }
+    return !gameOver;
+}
+
+bool Simulation::dropAt(int rotation, int col)
+{
+    if (gameOver)
+    {
+        return false;
+    }
+
+    // a drop always locks the piece, so the next one starts falling as after any other
+    gameOver = !board.dropAt(rotation, col);
+    gravityProgress = 0;
+    updateLevel();
+    return !gameOver;
+}
+
+bool Simulation::step()
+{
+    if (gameOver)
+    {
+        return false;
+    }
+
+    tick++;
+    gravityProgress += gravity;
+    // at high levels a piece can fall more than a row in one tick, but it stops falling once it locks
+    while (gravityProgress >= ONE_ROW)
+    {
+        gravityProgress -= ONE_ROW;
+        // locking resets gravityProgress, which ends the loop
+        if (!input(Direction::DOWN))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Simulation::advanceTo(std::uint64_t target)
+{
+    while (tick < target)
+    {
+        if (!step())
+        {
+            return false;
+        }
+    }
+    return !gameOver;
+}
+
+std::uint64_t Simulation::ticksUntilGravity() const
+{
+    return (ONE_ROW - gravityProgress + gravity - 1) / gravity;
+}
+
+void Simulation::takeSnapshot(RenderSnapshot& snapshot) const
+{
+    snapshot.tick = tick;
+    snapshot.rowMasks = board.rowMasks;
+    snapshot.colorGrid = board.colorGrid;
+    snapshot.clearedRows = board.lastClearedRows;
+    snapshot.clearSequence = board.numClears;
+    snapshot.rowsCompleted = board.rowsCompleted;
+    snapshot.level = level;
+    snapshot.gameOver = gameOver;
+
+    snapshot.activeRows.fill(0);
+    snapshot.ghostRows.fill(0);
+    const Piece* piece = board.getActivePiece();
+    if (piece)
+    {
+        int landingRow = board.landingRow(*piece);
+        for (int subRow = 0; subRow < Piece::MAX_HEIGHT; subRow++)
+        {
+            unsigned bits = Piece::rowBits(piece->tiles, subRow);
+            if (bits == 0)
+            {
+                continue;
+            }
+
+            bits = piece->col < 0 ? bits >> -piece->col : bits << piece->col;
+            if (piece->onBoard && piece->row + subRow >= 0 && piece->row + subRow < Board::NUM_ROWS)
+            {
+                snapshot.activeRows[piece->row + subRow] = Board::RowMaskType(bits);
+            }
+            if (landingRow + subRow < Board::NUM_ROWS)
+            {
+                snapshot.ghostRows[landingRow + subRow] = Board::RowMaskType(bits);
+            }
+        }
+        snapshot.activeColorIndex = piece->colorIndex;
+    }
+}
+
+void Simulation::snapshot(State& state) const
+{
+    board.snapshot(state.board);
+    state.tick = tick;
+    state.startLevel = startLevel;
+    state.level = level;
+    state.gravityProgress = gravityProgress;
+    state.gameOver = gameOver;
+}
+
+void Simulation::restore(const State& state)
+{
+    board.restore(state.board);
+    tick = state.tick;
+    startLevel = state.startLevel;
+    level = state.level;
+    gravity = gravityForLevel(level);
+    gravityProgress = state.gravityProgress;
+    gameOver = state.gameOver;
+}
+
+void Simulation::updateLevel()
+{
+    level = startLevel + board.rowsCompleted / ROWS_PER_LEVEL;
+    if (level > MAX_LEVEL)
+    {
+        level = MAX_LEVEL;
+    }
+    gravity = gravityForLevel(level);
+}
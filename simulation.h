@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "board.h"
+
+// everything the front end draws, copied out of a simulation so it can be drawn on another thread
+struct RenderSnapshot
+{
+    std::uint64_t tick = 0;
+    std::array<Board::RowMaskType, Board::NUM_ROWS> rowMasks = { 0 };
+    std::array<std::array<std::uint8_t, Board::NUM_COLS>, Board::NUM_ROWS> colorGrid = {};
+    // the active piece's own tiles, also set in rowMasks
+    std::array<Board::RowMaskType, Board::NUM_ROWS> activeRows = { 0 };
+    // where the active piece would land, drawn dimmed under the piece itself
+    std::array<Board::RowMaskType, Board::NUM_ROWS> ghostRows = { 0 };
+    int activeColorIndex = 0;
+    // Board::lastClearedRows and Board::numClears, a new clear is one with a higher count than the
+    // last snapshot's of the same game, a rollback can take the count back but a tick going back means a new game
+    Board::RowSetType clearedRows = 0;
+    std::uint32_t clearSequence = 0;
+    int rowsCompleted = 0;
+    int level = 0;
+    bool gameOver = false;
+};
+
+// runs a board on a fixed timestep, so a game only depends on its seed and on
+// which tick each input arrived, never on how fast ticks are being simulated
+//
+// nothing here reads a clock: the front end advances ticks to keep up with real
+// time, headless runs just call step as fast as they like
+class Simulation
+{
+public:
+    static constexpr int TICKS_PER_SECOND = 240;
+    static constexpr int MIN_LEVEL = 1;
+    static constexpr int MAX_LEVEL = 15;
+    static constexpr int ROWS_PER_LEVEL = 10;
+
+    // gravity is kept in rows per tick as 16.16 fixed point so its schedule is exact
+    static constexpr int GRAVITY_FRACTION_BITS = 16;
+    static constexpr std::uint32_t ONE_ROW = 1u << GRAVITY_FRACTION_BITS;
+
+    // microseconds a piece takes to fall one row at each level, from 1 second at
+    // level 1 down to 7ms (about 143 rows a second) at MAX_LEVEL
+    static constexpr std::array<std::uint32_t, MAX_LEVEL> MICROSECONDS_PER_ROW =
+    {
+        1000000, 793000, 617796, 472729, 355200,
+        262003, 189677, 134735, 93882, 64152,
+        42976, 28218, 18153, 11439, 7059
+    };
+
+    static constexpr std::uint32_t gravityForLevel(int level)
+    {
+        return std::uint32_t(std::uint64_t(ONE_ROW) * 1000000
+            / (std::uint64_t(TICKS_PER_SECOND) * MICROSECONDS_PER_ROW[level - MIN_LEVEL]));
+    }
+
+    Board board;
+    std::uint64_t tick = 0;
+    int startLevel = MIN_LEVEL;
+    int level = MIN_LEVEL;
+    // rows per tick for the current level
+    std::uint32_t gravity = 0;
+    // how far the active piece has fallen towards the next row
+    std::uint32_t gravityProgress = 0;
+    bool gameOver = false;
+
+    // the board's state plus the clock, enough to go back to an earlier tick and play on from there
+    struct State
+    {
+        Board::State board;
+        std::uint64_t tick;
+        std::int32_t startLevel;
+        std::int32_t level;
+        std::uint32_t gravityProgress;
+        bool gameOver;
+    };
+
+    explicit Simulation(std::uint64_t seed = 0, RandomizerMode mode = RandomizerMode::BAG, int startLevel = MIN_LEVEL);
+
+    // applies an input at the current tick, returns false once the game is over
+    bool input(Direction direction);
+    // for bots, Board::dropAt at the current tick, returns false once the game is over
+    bool dropAt(int rotation, int col);
+    // advances one tick, applying any gravity due, returns false once the game is over
+    bool step();
+    // steps until tick reaches target, stopping early if the game ends
+    bool advanceTo(std::uint64_t target);
+    // ticks from now until gravity next moves the active piece
+    std::uint64_t ticksUntilGravity() const;
+    void takeSnapshot(RenderSnapshot& snapshot) const;
+    void snapshot(State& state) const;
+    void restore(const State& state);
+private:
+    void updateLevel();
+};
@@ -1,491 +1,983 @@
 #include <SDL.h>
 #include <algorithm>
-#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <optional>
-#include <queue>
+#include <mutex>
 #include <random>
+#include <string>
+#include <thread>
 #include <vector>
 
-const int SCREEN_WIDTH = 640;
-const int SCREEN_HEIGHT = 480;
-const int TILE_WIDTH = 10;
-const int TILE_HEIGHT = 10;
-const int GRAVITY_DURATION_SECONDS = 1;
-
-enum class Direction
+#include "ai.h"
+#include "board.h"
+#include "handoff.h"
+#include "input.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "netplay.h"
+#include "profiler.h"
+#include "renderer.h"
+#include "replay.h"
+#include "simulation.h"
+
+// most ticks run in one go after a stall, a quarter of a second
+const int MAX_CATCH_UP_TICKS = Simulation::TICKS_PER_SECOND / 4;
+// the UDP port versus matches listen on unless --port says otherwise
+const int DEFAULT_PORT = 7777;
+// how long to wait for the peer of a versus match to start up
+const std::chrono::seconds CONNECT_TIMEOUT{ 60 };
+// how often a bot of the wall drops a piece, and how long its game stays up once it's over before the next one
+const int BOT_MOVE_TICKS = Simulation::TICKS_PER_SECOND / 4;
+const int BOT_RESTART_TICKS = Simulation::TICKS_PER_SECOND * 2;
+// windows can be resized, and get a pixel per display pixel on HiDPI displays
+const Uint32 WINDOW_FLAGS = SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI;
+// taken as statics are constructed, as near to the process starting as portable code gets
+const std::chrono::steady_clock::time_point PROCESS_START = std::chrono::steady_clock::now();
+
+// when each step of getting to the first frame was done, for --startup-time
+struct StartupTimes
 {
-    UP,
-    DOWN,
-    LEFT,
-    RIGHT
-};
+    using Clock = std::chrono::steady_clock;
 
-struct Color
-{
-    int red = 0;
-    int green = 0;
-    int blue = 0;
-    int alpha = 255;
-};
-const Color BLACK{ 0,0,0,255 };
-const Color RED{ 255,0,0,255 };
-const Color GREEN{ 0,255,0,255 };
-const Color BLUE{ 0,0,255,255 };
+    Clock::time_point sdlInit;
+    Clock::time_point window;
+    Clock::time_point renderer;
+    Clock::time_point boardRenderer;
+    Clock::time_point firstFrame;
 
-const Color DEFAULT_COLORS[]
-{
-    RED,
-    GREEN,
-    BLUE
+    // milliseconds each step took and the total since PROCESS_START
+    void print() const;
 };
 
-void drawTile(SDL_Renderer* renderer, Color color, int row, int col);
-
-class Board;
-
-class Piece
+// maps the wall clock onto simulation ticks, tick n is due n / TICKS_PER_SECOND seconds
+// after the start, worked out from the tick number each time so the schedule never drifts
+class TickClock
 {
 public:
-    static constexpr int NUM_DEFAULT_PIECES = 5;
-    static constexpr int MAX_HEIGHT = 4;
-    static constexpr int MAX_WIDTH = 4;
-
-    using TileGridType = std::array<std::array<bool, MAX_WIDTH>, MAX_HEIGHT>;
-    static constexpr std::array<TileGridType, NUM_DEFAULT_PIECES> DEFAULT_PIECES
-    { {
-        {{
-            {1,1,1,1},
-            {0,0,0,0},
-            {0,0,0,0},
-            {0,0,0,0}
-        }},
-        {{
-            {0,1,0,0},
-            {1,1,1,0},
-            {0,0,0,0},
-            {0,0,0,0}
-        }},
-        {{
-            {1,1,0,0},
-            {1,0,0,0},
-            {1,0,0,0},
-            {0,0,0,0}
-        }},
-        {{
-            {1,1,0,0},
-            {0,1,0,0},
-            {0,1,0,0},
-            {0,0,0,0}
-        }},
-        {{
-            {1,1,0,0},
-            {1,1,0,0},
-            {0,0,0,0},
-            {0,0,0,0}
-        }}
-    }};
-
-    TileGridType tileGrid = { false };
-    Color color = RED;
-    int row = 0;
-    int col = 0;
-
-    Piece();
-    void rotate(Board& board);
-    bool move(Direction direction, Board& board);
-    bool moveTo(int newRow, int newCol, TileGridType& newTileGrid, Board& board);
-    void draw(SDL_Renderer* renderer, std::optional<Color> color);
-    void removeTile(SDL_Renderer* renderer, Color backgroundColor, int rowToRemove, int colToRemove);
-
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point timeOf(std::uint64_t tick) const;
+    // the tick due at a time, which may be ahead of a simulation that stalled or ended
+    std::uint64_t tickAt(Clock::time_point time) const;
+    // runs every tick due by now with the inputs due on each, recording them when recording
+    // and passing them on to the peer in a versus match
+    void catchUp(Simulation& simulation, InputHandler& inputs, ReplayWriter& recorder, NetplaySession* session = nullptr);
 private:
+    Clock::time_point start = Clock::now();
 };
 
-class Board
+// one game of a bot wall, with its ticks counted from when it started on the wall's clock
+struct BotGame
 {
-public:
-    static constexpr int NUM_ROWS = 20;
-    static constexpr int NUM_COLS = 12;
-    static constexpr int START_X_PIXELS = SCREEN_WIDTH / 6;
-    static constexpr int START_Y_PIXELS = SCREEN_HEIGHT / 6;
-    static constexpr int BOARD_WIDTH_PIXELS = NUM_COLS * TILE_WIDTH;
-    static constexpr int BOARD_HEIGHT_PIXELS = NUM_ROWS * TILE_HEIGHT;
-
-    std::array<std::array<Piece*, NUM_COLS>, NUM_ROWS> pieceGrid = { nullptr };
-    std::vector<Piece> pieces;
-    Piece* activePiece = nullptr;
-    int rowsCompleted = 0;
-
-    Board(SDL_Renderer* renderer);
-    void draw();
-    bool isRowFull(int row);
-    void collapseFullRows();
-    bool update(Direction direction);
-private:
-    SDL_Renderer* renderer;
+    Simulation simulation;
+    std::uint64_t startTick = 0;
+    // the game's tick the bot next drops a piece on
+    std::uint64_t nextMoveTick = 0;
+};
 
-    void drawBorders();
+// a board key going down or up
+struct KeyEvent
+{
+    Direction direction = Direction::DOWN;
+    bool pressed = false;
 };
 
+// the board input bound to a key, if any
+bool keyDirection(SDL_Keycode key, Direction& direction);
+// the board key an event presses or releases, if any, OS key repeats are left out
+bool keyEvent(const SDL_Event& e, KeyEvent& keyEvent);
+void applyKeyEvent(const KeyEvent& keyEvent, InputHandler& inputs);
+// logic and drawing take turns on the main thread
+void runSingleThreaded(Simulation& simulation, BoardRenderer& boardRenderer, ReplayWriter& recorder, ProfileLog& profileLog, int maxFramesPerSecond);
+// the simulation runs on its own thread, so a slow present can't hold up gravity
+void runThreaded(Simulation& simulation, BoardRenderer& boardRenderer, ReplayWriter& recorder, ProfileLog& profileLog, int maxFramesPerSecond);
+// a versus match on the main thread, the local board drawn first and the peer's next to it
+void runVersus(NetplaySession& session, BoardRenderer& boardRenderer, ReplayWriter& recorder, ProfileLog& profileLog, int maxFramesPerSecond);
+// says hello to the peer until it answers, keeping the window responsive, returns false if it
+// never does or the window is closed first
+bool connectPeer(NetplaySession& session, std::uint64_t seed, int startLevel, SDL_Renderer* renderer);
+// runs the match and says who won, returns nonzero on an error
+int playVersus(NetplaySession& session, BoardRenderer& boardRenderer, ReplayWriter& recorder, ProfileLog& profileLog, int maxFramesPerSecond);
+// a wall of games played by BeamSearchAi, one per board of the renderer, each replaced by the next seed a while after it ends
+void runBots(std::uint64_t seed, int startLevel, BoardRenderer& boardRenderer, ProfileLog& profileLog, int maxFramesPerSecond);
+// splits host:port, with brackets allowed around an IPv6 host
+bool parseAddress(const char* address, std::string& host, int& port);
+
 int main(int argc, char** argv)
 {
+    // the same seed deals the same pieces, pass one to replay a game
+    std::uint64_t seed = std::random_device()();
+    const char* recordPath = nullptr;
+    int startLevel = Simulation::MIN_LEVEL;
+    // 0 draws every change, vsync permitting
+    int maxFramesPerSecond = 0;
+    bool threaded = false;
+    RendererBackend backend = RendererBackend::ATLAS;
+    const char* profilePath = nullptr;
+    bool showProfile = false;
+    // a versus match against the peer at this address, which has to be started with this end's address
+    const char* peerAddress = nullptr;
+    int localPort = DEFAULT_PORT;
+    // sprites for the atlas renderer in place of the palette's, see AtlasBoardRenderer::ATLAS_SIZE
+    const char* atlasPath = nullptr;
+    // prints how long it took to get the first frame up and quits
+    bool timeStartup = false;
+    // a Prometheus text file of the game's metrics, rewritten every few seconds
+    const char* metricsPath = nullptr;
+    // watch this many bots play in one window instead of playing
+    int numBots = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--level") == 0 && i + 1 < argc)
+        {
+            startLevel = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc)
+        {
+            maxFramesPerSecond = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--threaded") == 0)
+        {
+            threaded = true;
+        }
+        else if (std::strcmp(argv[i], "--renderer") == 0 && i + 1 < argc)
+        {
+            const char* name = argv[++i];
+            backend = std::strcmp(name, "rects") == 0 ? RendererBackend::RECTS : RendererBackend::ATLAS;
+        }
+        else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profilePath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--profile-overlay") == 0)
+        {
+            showProfile = true;
+        }
+        else if (std::strcmp(argv[i], "--connect") == 0 && i + 1 < argc)
+        {
+            peerAddress = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+        {
+            localPort = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--atlas") == 0 && i + 1 < argc)
+        {
+            atlasPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--startup-time") == 0)
+        {
+            timeStartup = true;
+        }
+        else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+        {
+            metricsPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--bots") == 0 && i + 1 < argc)
+        {
+            numBots = std::max(0, std::atoi(argv[++i]));
+        }
+    }
+
+    std::unique_ptr<NetplaySession> session;
+    if (peerAddress)
+    {
+        std::string peerHost;
+        int peerPort = 0;
+        session.reset(new NetplaySession());
+        if (!parseAddress(peerAddress, peerHost, peerPort) || !session->open(localPort, peerHost.c_str(), peerPort))
+        {
+            std::cout << "Error opening a connection to: " << peerAddress << '\n';
+            return -6;
+        }
+    }
+
+    // a versus replay starts on the seed and level both ends agree on, so it's opened once they've met
+    ReplayWriter recorder;
+    if (recordPath && !session && !recorder.open(recordPath, seed, RandomizerMode::BAG, startLevel))
+    {
+        std::cout << "Error creating replay file: " << recordPath << '\n';
+        return -4;
+    }
+
+    ProfileLog profileLog;
+    if (profilePath && !profileLog.open(profilePath))
+    {
+        std::cout << "Error creating profile file: " << profilePath << '\n';
+        return -5;
+    }
+
+    MetricsExporter metricsExporter;
+    if (metricsPath && !metricsExporter.start(metricsPath))
+    {
+        std::cout << "Error creating metrics file: " << metricsPath << '\n';
+        return -10;
+    }
+
+    // mapped rather than read, the texture upload is the only pass over it
+    MappedFile atlasFile;
+    if (atlasPath && (!atlasFile.open(atlasPath) || atlasFile.size() != AtlasBoardRenderer::ATLAS_SIZE))
+    {
+        std::cout << "Error loading atlas, it has to be " << AtlasBoardRenderer::ATLAS_SIZE << " bytes of RGBA: " << atlasPath << '\n';
+        return -9;
+    }
+
+    // video is the only subsystem the game needs, anything else would only slow startup down
+    StartupTimes startupTimes;
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
-        std::cout << "SDL init error: " << SDL_GetError() << std::endl;
+        std::cout << "SDL init error: " << SDL_GetError() << '\n';
         return -1;
     }
-
-    SDL_Window* window = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+    startupTimes.sdlInit = StartupTimes::Clock::now();
+
+    // every board goes in the one window, scaled to whatever size it's given, in pixels on HiDPI displays
+    int numBoards = session ? 2 : numBots > 0 ? numBots : 1;
+    int windowWidth = SCREEN_WIDTH;
+    int windowHeight = SCREEN_HEIGHT;
+    minimumOutputSize(numBoards, windowWidth, windowHeight);
+    SDL_Window* window = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, windowWidth, windowHeight, WINDOW_FLAGS);
     if (!window)
     {
-        std::cout << "SDL create window error: " << SDL_GetError() << std::endl;
+        std::cout << "SDL create window error: " << SDL_GetError() << '\n';
         return -2;
     }
+    SDL_SetWindowMinimumSize(window, windowWidth, windowHeight);
+    startupTimes.window = StartupTimes::Clock::now();
 
-    SDL_Surface* screenSurface = SDL_GetWindowSurface(window);
-    SDL_FillRect(screenSurface, NULL, SDL_MapRGB(screenSurface->format, 0xFF, 0xFF, 0xFF));
-    SDL_UpdateWindowSurface(window);
-
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // straight to the renderer, the window's contents are never drawn any other way.
+    // vsync caps presents at one per displayed frame
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (!renderer)
     {
-        std::cout << "Error creating Renderer: " << SDL_GetError() << std::endl;
+        std::cout << "Error creating Renderer: " << SDL_GetError() << '\n';
         return -3;
     }
+    startupTimes.renderer = StartupTimes::Clock::now();
 
-    Board board(renderer);
-    board.draw();
+    std::unique_ptr<BoardRenderer> boardRenderer = createBoardRenderer(renderer, backend, atlasFile.data(), numBoards);
+    if (!boardRenderer)
+    {
+        // every renderer can fill rects
+        std::cout << "Texture atlas unsupported, drawing rects: " << SDL_GetError() << '\n';
+        boardRenderer = createBoardRenderer(renderer, RendererBackend::RECTS, nullptr, numBoards);
+    }
+    startupTimes.boardRenderer = StartupTimes::Clock::now();
 
-    // TODO levels of difficulty
-    auto gravityDeadline = std::chrono::steady_clock::now();
+    // only made when it's shown, its batch of font pixels is tens of kilobytes
+    std::unique_ptr<ProfileOverlay> profileOverlay;
+    if (showProfile)
+    {
+        profileOverlay.reset(new ProfileOverlay(renderer));
+        boardRenderer->overlay = profileOverlay.get();
+    }
+    profiler.setEnabled(showProfile || profileLog.isOpen());
 
-    bool quit = false;
-    bool updateSuccess = true;
-    while(!quit)
+    int result = 0;
+    if (session)
     {
-        auto now = std::chrono::steady_clock::now();
-        if(now > gravityDeadline)
+        // met only once everything's set up, the first tick comes right after and a slow
+        // startup at one end doesn't put its clock behind the other's
+        std::cout << "Waiting for " << peerAddress << "..." << std::endl;
+        if (!connectPeer(*session, seed, startLevel, renderer))
         {
-            gravityDeadline = now + std::chrono::seconds(GRAVITY_DURATION_SECONDS);
-            board.update(Direction::DOWN);
+            std::cout << "No answer from: " << peerAddress << '\n';
+            result = -7;
         }
-
-        SDL_Event e;
-        while (SDL_PollEvent(&e))
+        else if (recordPath && !recorder.open(recordPath, session->seed(), RandomizerMode::BAG, session->local.startLevel))
         {
-            switch (e.type)
-            {
-            case SDL_QUIT:
-                quit = true;
-                break;
-            case SDL_KEYDOWN:
-            {
-                switch (e.key.keysym.sym)
-                {
-                case SDLK_UP:
-                    updateSuccess = board.update(Direction::UP);
-                    break;
-                case SDLK_DOWN:
-                    updateSuccess = board.update(Direction::DOWN);
-                    break;
-                case SDLK_LEFT:
-                    updateSuccess = board.update(Direction::LEFT);
-                    break;
-                case SDLK_RIGHT:
-                    updateSuccess = board.update(Direction::RIGHT);
-                    break;
-                default:
-                    break;
-                }
-                break;
-            }
-            default:
-                break;
-            }
-
-            if(!updateSuccess)
-            {
-                quit = true;
-            }
+            std::cout << "Error creating replay file: " << recordPath << '\n';
+            result = -4;
+        }
+        else
+        {
+            result = playVersus(*session, *boardRenderer, recorder, profileLog, maxFramesPerSecond);
+            recorder.close(session->local.tick);
+        }
+    }
+    else if (numBots > 0)
+    {
+        runBots(seed, startLevel, *boardRenderer, profileLog, maxFramesPerSecond);
+    }
+    else
+    {
+        Simulation simulation(seed, RandomizerMode::BAG, startLevel);
+        RenderSnapshot snapshot;
+        simulation.takeSnapshot(snapshot);
+        boardRenderer->invalidate();
+        boardRenderer->update(snapshot);
+        boardRenderer->present();
+        startupTimes.firstFrame = StartupTimes::Clock::now();
+
+        if (timeStartup)
+        {
+            startupTimes.print();
+        }
+        else if (threaded)
+        {
+            runThreaded(simulation, *boardRenderer, recorder, profileLog, maxFramesPerSecond);
+        }
+        else
+        {
+            runSingleThreaded(simulation, *boardRenderer, recorder, profileLog, maxFramesPerSecond);
         }
 
-        if (!updateSuccess)
+        if (simulation.gameOver)
         {
-            std::cout << "Game Over!" << std::endl;
+            std::cout << "Rows Completed: " << simulation.board.rowsCompleted << '\n';
+            std::cout << "Level: " << simulation.level << '\n';
+            std::cout << "Seed: " << seed << '\n';
+            std::cout << "Game Over!\n";
         }
+        recorder.close(simulation.tick);
     }
 
+    profileLog.close();
+    metricsExporter.stop();
+    boardRenderer.reset();
+    SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
-    return 0;
+    return result;
 }
 
-void drawTile(SDL_Renderer* renderer, Color color, int row, int col)
+bool connectPeer(NetplaySession& session, std::uint64_t seed, int startLevel, SDL_Renderer* renderer)
 {
-    SDL_SetRenderDrawColor(renderer, color.red, color.green, color.blue, color.alpha);
-
-    SDL_Rect rect;
-    rect.x = Board::START_X_PIXELS + col * TILE_WIDTH;
-    rect.y = Board::START_Y_PIXELS + row * TILE_HEIGHT;
-    rect.w = TILE_WIDTH;
-    rect.h = TILE_HEIGHT;
-
-    SDL_RenderFillRect(renderer, &rect);
-}
+    // nothing's been drawn yet, and the boards only go up once the seed is known
+    SDL_RenderClear(renderer);
+    SDL_RenderPresent(renderer);
 
-bool Piece::moveTo(int newRow, int newCol, TileGridType& newTileGrid, Board& board)
-{
-    for (int subRow = 0; subRow < MAX_HEIGHT; subRow++)
+    // a hello at a time, connect can start over as long as nothing has come back
+    auto giveUpAt = NetplaySession::Clock::now() + CONNECT_TIMEOUT;
+    while (NetplaySession::Clock::now() < giveUpAt)
     {
-        for (int subCol = 0; subCol < MAX_WIDTH; subCol++)
+        if (session.connect(seed, startLevel, NetplaySession::HELLO_INTERVAL))
         {
-            if (!newTileGrid[subRow][subCol])
-            {
-                // not an actual part of the piece so ignore
-                continue;
-            }
-
-            // where this tile lands of the full board
-            int absoluteRow = newRow + subRow;
-            int absoluteCol = newCol + subCol;
-
-            if (absoluteRow < 0 || absoluteRow >= Board::NUM_ROWS
-                || absoluteCol < 0 || absoluteCol >= Board::NUM_COLS)
-            {
-                // piece lands out of bounds of the full board
-                return false;
-            }
-
-            if (board.pieceGrid[absoluteRow][absoluteCol] != nullptr
-                && board.pieceGrid[absoluteRow][absoluteCol] != this)
+            return true;
+        }
+        SDL_Event e;
+        while (SDL_PollEvent(&e))
+        {
+            if (e.type == SDL_QUIT)
             {
-                // this spot of the full board is already taken
                 return false;
             }
         }
     }
+    return false;
+}
+
+int playVersus(NetplaySession& session, BoardRenderer& boardRenderer, ReplayWriter& recorder, ProfileLog& profileLog, int maxFramesPerSecond)
+{
+    runVersus(session, boardRenderer, recorder, profileLog, maxFramesPerSecond);
 
-    for (int subRow = 0; subRow < MAX_HEIGHT; subRow++)
+    int result = 0;
+    if (session.local.gameOver && session.remoteFinished)
     {
-        for (int subCol = 0; subCol < MAX_WIDTH; subCol++)
-        {
-            if (tileGrid[subRow][subCol])
-            {
-                int r = row + subRow;
-                int c = col + subCol;
-                board.pieceGrid[r][c] = nullptr;
-            }
-        }
+        // whoever stays up longer wins, rows break a tie
+        const Simulation& local = session.local;
+        const Simulation& remote = session.remote;
+        bool won = local.tick != remote.tick ? local.tick > remote.tick : local.board.rowsCompleted > remote.board.rowsCompleted;
+        bool tied = local.tick == remote.tick && local.board.rowsCompleted == remote.board.rowsCompleted;
+        std::cout << "Rows Completed: " << local.board.rowsCompleted << " to " << remote.board.rowsCompleted << '\n';
+        std::cout << "Seed: " << session.seed() << '\n';
+        std::cout << (tied ? "Draw!" : won ? "You Win!" : "You Lose!") << '\n';
     }
-
-    for (int subRow = 0; subRow < MAX_HEIGHT; subRow++)
+    else if (session.isDisconnected())
     {
-        for (int subCol = 0; subCol < MAX_WIDTH; subCol++)
-        {
-            if (newTileGrid[subRow][subCol])
-            {
-                int r = newRow + subRow;
-                int c = newCol + subCol;
-                board.pieceGrid[r][c] = this;
-            }
-        }
+        std::cout << "Connection lost\n";
+        result = -8;
     }
-
-    row = newRow;
-    col = newCol;
-
-    return true;
+    std::cout << "Rollbacks: " << session.rollbacks << ", ticks simulated again: " << session.resimulatedTicks << '\n';
+    return result;
 }
 
-Piece::Piece()
+bool keyDirection(SDL_Keycode key, Direction& direction)
 {
-    static std::random_device rd;
-    tileGrid = DEFAULT_PIECES[rd() % NUM_DEFAULT_PIECES];
-    static int colorIndex = 0;
-    color = DEFAULT_COLORS[colorIndex];
-    colorIndex = (colorIndex + 1) % (sizeof(DEFAULT_COLORS) / sizeof(Color));
+    switch (key)
+    {
+    case SDLK_UP:
+        direction = Direction::UP;
+        return true;
+    case SDLK_DOWN:
+        direction = Direction::DOWN;
+        return true;
+    case SDLK_LEFT:
+        direction = Direction::LEFT;
+        return true;
+    case SDLK_RIGHT:
+        direction = Direction::RIGHT;
+        return true;
+    case SDLK_SPACE:
+        direction = Direction::DROP;
+        return true;
+    default:
+        return false;
+    }
 }
 
-void Piece::rotate(Board& board)
+bool keyEvent(const SDL_Event& e, KeyEvent& keyEvent)
 {
-    TileGridType newTileGrid = { false };
-
-    for (int sourceRow = 0; sourceRow < MAX_HEIGHT; sourceRow++)
+    // held keys repeat on simulation ticks, not whenever the OS repeats them
+    if ((e.type != SDL_KEYDOWN && e.type != SDL_KEYUP) || e.key.repeat != 0)
     {
-        for (int sourceCol = 0; sourceCol < MAX_WIDTH; sourceCol++)
-        {
-            int destRow = sourceCol;
-            int destCol = MAX_HEIGHT - sourceRow - 1;
-            newTileGrid[destRow][destCol] = tileGrid[sourceRow][sourceCol];
-        }
+        return false;
     }
 
-    if (moveTo(row, col, newTileGrid, board))
-    {
-        tileGrid = newTileGrid;
-    }
+    keyEvent.pressed = e.type == SDL_KEYDOWN;
+    return keyDirection(e.key.keysym.sym, keyEvent.direction);
 }
 
-bool Piece::move(Direction direction, Board& board)
+void applyKeyEvent(const KeyEvent& keyEvent, InputHandler& inputs)
 {
-    int newRow = row + (direction == Direction::DOWN) - (direction == Direction::UP);
-    int newCol = col + (direction == Direction::RIGHT) - (direction == Direction::LEFT);
-    return !moveTo(newRow, newCol, tileGrid, board) && direction == Direction::DOWN;
+    if (keyEvent.pressed)
+    {
+        inputs.press(keyEvent.direction);
+    }
+    else
+    {
+        inputs.release(keyEvent.direction);
+    }
 }
 
-void Piece::draw(SDL_Renderer* renderer, std::optional<Color> color)
+void runSingleThreaded(Simulation& simulation, BoardRenderer& boardRenderer, ReplayWriter& recorder, ProfileLog& profileLog, int maxFramesPerSecond)
 {
-    for (int subRow = 0; subRow < MAX_HEIGHT; subRow++)
+    using Clock = TickClock::Clock;
+    TickClock tickClock;
+    InputHandler inputs;
+    RenderSnapshot snapshot;
+    auto frameInterval = maxFramesPerSecond > 0 ? std::chrono::nanoseconds(1000000000 / maxFramesPerSecond) : std::chrono::nanoseconds(0);
+    auto nextFrame = Clock::now();
+    FrameTimer frameTimer;
+    bool quit = false;
+    while (!quit && !simulation.gameOver)
     {
-        for (int subCol = 0; subCol < MAX_WIDTH; subCol++)
+        // one update of the board for everything that happened since the last frame, then one render
+        tickClock.catchUp(simulation, inputs, recorder);
+        simulation.takeSnapshot(snapshot);
+        boardRenderer.update(snapshot);
+        if (boardRenderer.isDirty())
         {
-            if (tileGrid[subRow][subCol])
+            frameTimer.changed();
+        }
+
+        // the render stage only runs when something changed, and at most once per frame interval
+        if (boardRenderer.isDirty() && Clock::now() >= nextFrame)
+        {
+            frameTimer.begin();
+            boardRenderer.present();
+            frameTimer.end();
+            nextFrame = Clock::now() + frameInterval;
+        }
+        profileLog.update();
+
+        // sleep until input arrives, gravity next moves the piece, a held key repeats or a skipped frame is due
+        auto wakeAt = tickClock.timeOf(std::min(simulation.tick + simulation.ticksUntilGravity(), inputs.nextRepeatTick()));
+        if (boardRenderer.isDirty())
+        {
+            wakeAt = std::min(wakeAt, nextFrame);
+        }
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(wakeAt - Clock::now());
+        SDL_Event e;
+        bool hasEvent = SDL_WaitEventTimeout(&e, std::max(0, int(timeout.count())));
+        while (hasEvent && !simulation.gameOver)
+        {
+            KeyEvent key;
+            if (e.type == SDL_QUIT)
+            {
+                quit = true;
+            }
+            else if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET)
+            {
+                boardRenderer.invalidate();
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            {
+                boardRenderer.updateLayout();
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_FOCUS_LOST)
+            {
+                // the key ups go to whichever window has focus now
+                inputs.releaseAll();
+            }
+            else if (keyEvent(e, key))
             {
-                drawTile(renderer, color ? *color : this->color, row + subRow, col + subCol);
+                // ticks that came due while the events queued up run first, so each press lands
+                // on about the tick it arrived on, but nothing is drawn until the queue is empty
+                tickClock.catchUp(simulation, inputs, recorder);
+                applyKeyEvent(key, inputs);
             }
+
+            // drain whatever else is queued before drawing
+            hasEvent = SDL_PollEvent(&e);
         }
     }
+
+    simulation.takeSnapshot(snapshot);
+    boardRenderer.update(snapshot);
+    boardRenderer.present();
 }
 
-void Piece::removeTile(SDL_Renderer* renderer, Color backgroundColor, int rowToRemove, int colToRemove)
+void runThreaded(Simulation& simulation, BoardRenderer& boardRenderer, ReplayWriter& recorder, ProfileLog& profileLog, int maxFramesPerSecond)
 {
-    int subRow = rowToRemove - row;
-    int subCol = colToRemove - col;
-    if (!tileGrid[subRow][subCol])
+    // posted to the main thread when a snapshot is published, at most one queued at a time
+    Uint32 snapshotEvent = SDL_RegisterEvents(1);
+    if (snapshotEvent == Uint32(-1))
     {
+        std::cout << "Error registering events, running single threaded: " << SDL_GetError() << '\n';
+        runSingleThreaded(simulation, boardRenderer, recorder, profileLog, maxFramesPerSecond);
         return;
     }
+    std::atomic<bool> snapshotEventQueued{ false };
 
-    drawTile(renderer, backgroundColor, rowToRemove, colToRemove);
-    tileGrid[subRow][subCol] = false;
-}
+    // keys go one way and snapshots the other without either thread taking a lock,
+    // the mutex and condition variable only let the simulation sleep until it's needed
+    SpscQueue<KeyEvent, 64> keyEvents;
+    TripleBuffer<RenderSnapshot> snapshots;
+    std::atomic<bool> running{ true };
+    std::mutex wakeMutex;
+    std::condition_variable wake;
 
-Board::Board(SDL_Renderer* renderer) : renderer(renderer)
-{
-    pieces.reserve(NUM_ROWS * NUM_COLS);
-    activePiece = &pieces.emplace_back();
-}
+    std::thread simulationThread([&]()
+    {
+        TickClock tickClock;
+        InputHandler inputs;
+        while (running.load(std::memory_order_acquire))
+        {
+            tickClock.catchUp(simulation, inputs, recorder);
+            KeyEvent key;
+            while (!simulation.gameOver && keyEvents.pop(key))
+            {
+                applyKeyEvent(key, inputs);
+                tickClock.catchUp(simulation, inputs, recorder);
+            }
 
-void Board::draw()
-{
-    drawBorders();
-    for (Piece& piece : pieces)
+            simulation.takeSnapshot(snapshots.writeBuffer());
+            snapshots.publish();
+            if (!snapshotEventQueued.exchange(true, std::memory_order_acq_rel))
+            {
+                SDL_Event event = {};
+                event.type = snapshotEvent;
+                SDL_PushEvent(&event);
+            }
+
+            if (simulation.gameOver)
+            {
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            auto wakeTick = std::min(simulation.tick + simulation.ticksUntilGravity(), inputs.nextRepeatTick());
+            wake.wait_until(lock, tickClock.timeOf(wakeTick), [&]()
+            {
+                return !keyEvents.empty() || !running.load(std::memory_order_acquire);
+            });
+        }
+    });
+
+    auto notifySimulation = [&]()
     {
-        piece.draw(renderer, std::nullopt);
-    }
-    SDL_RenderPresent(renderer);
-}
+        // taking the lock means the simulation is either before its check or already waiting
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+        }
+        wake.notify_one();
+    };
 
-bool Board::isRowFull(int row)
-{
-    for (int col = 0; col < NUM_COLS; col++)
+    using Clock = TickClock::Clock;
+    auto frameInterval = maxFramesPerSecond > 0 ? std::chrono::nanoseconds(1000000000 / maxFramesPerSecond) : std::chrono::nanoseconds(0);
+    auto nextFrame = Clock::now();
+    FrameTimer frameTimer;
+    bool quit = false;
+    bool gameOver = false;
+    while (!quit && !gameOver)
     {
-        if (pieceGrid[row][col] == nullptr)
+        // nothing to do until an event or a new snapshot arrives, unless a frame was skipped
+        int timeout = -1;
+        if (boardRenderer.isDirty())
         {
-            return false;
+            timeout = std::max(0, int(std::chrono::ceil<std::chrono::milliseconds>(nextFrame - Clock::now()).count()));
         }
+
+        SDL_Event e;
+        bool hasEvent = timeout < 0 ? SDL_WaitEvent(&e) : SDL_WaitEventTimeout(&e, timeout);
+        bool keysQueued = false;
+        while (hasEvent)
+        {
+            KeyEvent key;
+            if (e.type == SDL_QUIT)
+            {
+                quit = true;
+            }
+            else if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET)
+            {
+                boardRenderer.invalidate();
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            {
+                boardRenderer.updateLayout();
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_FOCUS_LOST)
+            {
+                // the key ups go to whichever window has focus now
+                for (int i = 0; i < InputHandler::NUM_KEYS; i++)
+                {
+                    KeyEvent release;
+                    release.direction = Direction(i);
+                    keysQueued |= keyEvents.push(release);
+                }
+            }
+            else if (keyEvent(e, key))
+            {
+                // a full queue means the simulation is far behind, dropping the key is the least surprising
+                keysQueued |= keyEvents.push(key);
+            }
+            else if (e.type == snapshotEvent)
+            {
+                // cleared before reading so a snapshot published meanwhile posts another event
+                snapshotEventQueued.store(false, std::memory_order_release);
+                if (snapshots.update())
+                {
+                    boardRenderer.update(snapshots.readBuffer());
+                    gameOver = snapshots.readBuffer().gameOver;
+                    if (boardRenderer.isDirty())
+                    {
+                        frameTimer.changed();
+                    }
+                }
+            }
+            hasEvent = SDL_PollEvent(&e);
+        }
+
+        // one wake up for everything drained, the simulation applies it all on its next tick
+        if (keysQueued)
+        {
+            notifySimulation();
+        }
+
+        if (boardRenderer.isDirty() && (gameOver || Clock::now() >= nextFrame))
+        {
+            frameTimer.begin();
+            boardRenderer.present();
+            frameTimer.end();
+            nextFrame = Clock::now() + frameInterval;
+        }
+        profileLog.update();
     }
 
-    rowsCompleted++;
-    return true;
+    running.store(false, std::memory_order_release);
+    notifySimulation();
+    simulationThread.join();
 }
 
-void Board::collapseFullRows()
+void runVersus(NetplaySession& session, BoardRenderer& boardRenderer, ReplayWriter& recorder, ProfileLog& profileLog, int maxFramesPerSecond)
 {
-    for (int row = 0; row < NUM_ROWS; row++)
+    using Clock = TickClock::Clock;
+    // both ends start their clocks as they meet, so tick n is about the same moment at both
+    TickClock tickClock;
+    InputHandler inputs;
+    RenderSnapshot snapshot;
+    auto frameInterval = maxFramesPerSecond > 0 ? std::chrono::nanoseconds(1000000000 / maxFramesPerSecond) : std::chrono::nanoseconds(0);
+    auto nextFrame = Clock::now();
+    FrameTimer frameTimer;
+    boardRenderer.invalidate();
+
+    bool quit = false;
+    while (!quit && !session.isMatchOver() && !session.isDisconnected())
     {
-        if (!isRowFull(row))
+        // the local board stops when its game is over, the peer's keeps up with the clock
+        tickClock.catchUp(session.local, inputs, recorder, &session);
+        session.receive();
+        session.predictRemote(tickClock.tickAt(Clock::now()));
+        session.update();
+
+        session.local.takeSnapshot(snapshot);
+        boardRenderer.update(snapshot, 0);
+        session.remote.takeSnapshot(snapshot);
+        boardRenderer.update(snapshot, 1);
+        bool dirty = boardRenderer.isDirty();
+        if (dirty)
         {
-            continue;
+            frameTimer.changed();
         }
+        if (dirty && Clock::now() >= nextFrame)
+        {
+            frameTimer.begin();
+            boardRenderer.present();
+            frameTimer.end();
+            nextFrame = Clock::now() + frameInterval;
+        }
+        profileLog.update();
 
-        for (int col = 0; col < NUM_COLS; col++)
+        // as in runSingleThreaded, but packets have to go out and come in on time as well
+        auto wakeAt = std::min(session.nextSendTime(), tickClock.timeOf(std::min(session.local.tick + session.local.ticksUntilGravity(), inputs.nextRepeatTick())));
+        if (dirty)
         {
-            pieceGrid[row][col]->removeTile(renderer, BLACK, row, col);
-            pieceGrid[row][col] = nullptr;
+            wakeAt = std::min(wakeAt, nextFrame);
         }
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(wakeAt - Clock::now());
+        SDL_Event e;
+        bool hasEvent = SDL_WaitEventTimeout(&e, std::max(0, int(timeout.count())));
+        while (hasEvent)
+        {
+            KeyEvent key;
+            if (e.type == SDL_QUIT)
+            {
+                quit = true;
+            }
+            else if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET)
+            {
+                boardRenderer.invalidate();
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            {
+                boardRenderer.updateLayout();
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_FOCUS_LOST)
+            {
+                inputs.releaseAll();
+            }
+            else if (keyEvent(e, key))
+            {
+                tickClock.catchUp(session.local, inputs, recorder, &session);
+                applyKeyEvent(key, inputs);
+            }
+            hasEvent = SDL_PollEvent(&e);
+        }
+    }
+}
 
-        // erase pieces that have no tiles left of the board
-        pieces.erase(
-            std::remove_if(
-                pieces.begin(),
-                pieces.end(),
-                [](Piece& piece)
+void runBots(std::uint64_t seed, int startLevel, BoardRenderer& boardRenderer, ProfileLog& profileLog, int maxFramesPerSecond)
+{
+    using Clock = TickClock::Clock;
+    TickClock tickClock;
+    BeamSearchAi ai;
+    int numBots = boardRenderer.getNumBoards();
+    std::uint64_t nextSeed = seed;
+    std::vector<BotGame> games(numBots);
+    for (int i = 0; i < numBots; i++)
+    {
+        games[i].simulation = Simulation(nextSeed++, RandomizerMode::BAG, startLevel);
+        // staggered, so the searches are spread out rather than all landing on one frame
+        games[i].nextMoveTick = std::uint64_t(BOT_MOVE_TICKS) * std::uint64_t(i + 1) / std::uint64_t(numBots);
+    }
+
+    RenderSnapshot snapshot;
+    auto frameInterval = maxFramesPerSecond > 0 ? std::chrono::nanoseconds(1000000000 / maxFramesPerSecond) : std::chrono::nanoseconds(0);
+    auto nextFrame = Clock::now();
+    FrameTimer frameTimer;
+    boardRenderer.invalidate();
+    bool quit = false;
+    while (!quit)
+    {
+        // every game up to the clock, then one frame of all of them
+        std::uint64_t now = tickClock.tickAt(Clock::now());
+        std::uint64_t wakeTick = UINT64_MAX;
+        for (int i = 0; i < numBots; i++)
+        {
+            BotGame& game = games[i];
+            Simulation& simulation = game.simulation;
+            if (simulation.gameOver && now >= game.startTick + simulation.tick + BOT_RESTART_TICKS)
+            {
+                simulation = Simulation(nextSeed++, RandomizerMode::BAG, startLevel);
+                game.startTick = now;
+                game.nextMoveTick = BOT_MOVE_TICKS;
+            }
+
+            std::uint64_t target = now - game.startTick;
+            if (target > simulation.tick + MAX_CATCH_UP_TICKS)
+            {
+                // as in TickClock::catchUp, a stall is dropped rather than played through
+                game.startTick += target - simulation.tick - MAX_CATCH_UP_TICKS;
+                target = simulation.tick + MAX_CATCH_UP_TICKS;
+            }
+            while (!simulation.gameOver)
+            {
+                simulation.advanceTo(std::min(target, game.nextMoveTick));
+                if (!simulation.gameOver && simulation.tick >= game.nextMoveTick)
                 {
-                    for (int row = 0; row < Piece::MAX_HEIGHT; row++)
+                    AiMove move;
+                    if (ai.chooseMove(simulation.board, move))
                     {
-                        for (int col = 0; col < Piece::MAX_WIDTH; col++)
-                        {
-                            if (piece.tileGrid[row][col])
-                            {
-                                return false;
-                            }
-                        }
+                        simulation.dropAt(move.rotation, move.col);
                     }
+                    else
+                    {
+                        simulation.input(Direction::DROP);
+                    }
+                    game.nextMoveTick = simulation.tick + BOT_MOVE_TICKS;
+                }
+                if (simulation.tick >= target)
+                {
+                    break;
+                }
+            }
 
-                    return true;
-                }),
-            pieces.end());
+            simulation.takeSnapshot(snapshot);
+            boardRenderer.update(snapshot, i);
+            std::uint64_t due = simulation.gameOver ? simulation.tick + BOT_RESTART_TICKS
+                : std::min(simulation.tick + simulation.ticksUntilGravity(), game.nextMoveTick);
+            wakeTick = std::min(wakeTick, game.startTick + due);
+        }
 
-        // re-write pieceGrid since addresses will change if any piece were erased
-        pieceGrid = { nullptr };
-        for (Piece& piece : pieces)
+        if (boardRenderer.isDirty())
         {
-            piece.moveTo(piece.row, piece.col, piece.tileGrid, *this);
+            frameTimer.changed();
         }
-
-
-        for (Piece& piece : pieces)
+        if (boardRenderer.isDirty() && Clock::now() >= nextFrame)
         {
-            piece.draw(renderer, BLACK /* background color */);
-            while (!piece.move(Direction::DOWN, *this)) {}
-            piece.draw(renderer, std::nullopt);
+            frameTimer.begin();
+            boardRenderer.present();
+            frameTimer.end();
+            nextFrame = Clock::now() + frameInterval;
         }
+        profileLog.update();
 
-        // TODO piece breaks into 2 pieces (rare)
+        // nothing to do until a piece of any game moves, a game restarts or a skipped frame is due
+        auto wakeAt = tickClock.timeOf(wakeTick);
+        if (boardRenderer.isDirty())
+        {
+            wakeAt = std::min(wakeAt, nextFrame);
+        }
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(wakeAt - Clock::now());
+        SDL_Event e;
+        bool hasEvent = SDL_WaitEventTimeout(&e, std::max(0, int(timeout.count())));
+        while (hasEvent)
+        {
+            if (e.type == SDL_QUIT)
+            {
+                quit = true;
+            }
+            else if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET)
+            {
+                boardRenderer.invalidate();
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            {
+                boardRenderer.updateLayout();
+            }
+            hasEvent = SDL_PollEvent(&e);
+        }
     }
 }
 
-bool Board::update(Direction direction)
+void StartupTimes::print() const
 {
-    bool result = true;
-
-    // TODO move draw function inside Piece::move
-    activePiece->draw(renderer, BLACK /* background color */);
+    auto milliseconds = [](Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    };
+    std::cout << "Up to SDL_Init: " << milliseconds(PROCESS_START, sdlInit) << "ms" << '\n'
+        << "Window: " << milliseconds(sdlInit, window) << "ms" << '\n'
+        << "Renderer: " << milliseconds(window, renderer) << "ms" << '\n'
+        << "Board renderer: " << milliseconds(renderer, boardRenderer) << "ms" << '\n'
+        << "First frame: " << milliseconds(boardRenderer, firstFrame) << "ms" << '\n'
+        << "Time to first frame: " << milliseconds(PROCESS_START, firstFrame) << "ms" << '\n';
+}
 
-    bool shouldSpawn = false;
-    if (direction == Direction::UP)
+bool parseAddress(const char* address, std::string& host, int& port)
+{
+    const char* colon = std::strrchr(address, ':');
+    if (!colon || colon == address)
     {
-        activePiece->rotate(*this);
+        return false;
     }
-    else
+
+    host.assign(address, colon);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']')
     {
-        shouldSpawn = activePiece->move(direction, *this);
+        host = host.substr(1, host.size() - 2);
     }
-    activePiece->draw(renderer, std::nullopt);
+    port = std::atoi(colon + 1);
+    return port > 0 && port < 65536;
+}
+
+TickClock::Clock::time_point TickClock::timeOf(std::uint64_t tick) const
+{
+    return start + std::chrono::nanoseconds(tick * 1000000000ull / Simulation::TICKS_PER_SECOND);
+}
 
-    if (shouldSpawn)
+std::uint64_t TickClock::tickAt(Clock::time_point time) const
+{
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(time - start).count())
+        * Simulation::TICKS_PER_SECOND / 1000000000ull;
+}
+
+void TickClock::catchUp(Simulation& simulation, InputHandler& inputs, ReplayWriter& recorder, NetplaySession* session)
+{
+    auto now = Clock::now();
+    std::uint64_t target = tickAt(now);
+    if (target > simulation.tick + MAX_CATCH_UP_TICKS)
     {
-        collapseFullRows();
-        activePiece = &pieces.emplace_back();
+        // after a long stall, e.g. the window being dragged, drop the missed time instead of
+        // letting gravity slam the piece down all at once
+        target = simulation.tick + MAX_CATCH_UP_TICKS;
+        start = now - (timeOf(target) - start);
+    }
 
-        if (!activePiece->moveTo(activePiece->row, activePiece->col, activePiece->tileGrid, *this))
+    // what the board looked like after the last input or tick, for the metrics
+    const Board& board = simulation.board;
+    std::uint32_t numClears = board.numClears;
+    int rowsCompleted = board.rowsCompleted;
+    PieceHandle activePiece = board.activePiece;
+    auto countChanges = [&]()
+    {
+        if (board.activePiece.index != activePiece.index || board.activePiece.generation != activePiece.generation)
         {
-            std::cout << "Rows Completed: " << rowsCompleted << std::endl;
-            pieces.pop_back();
-            result = false;
+            metrics.add(MetricCounter::PIECES_SPAWNED);
+            activePiece = board.activePiece;
         }
-    }
+        if (board.numClears != numClears)
+        {
+            // rows that settling pieces filled afterwards belong to the same clear
+            metrics.addClear(board.rowsCompleted - rowsCompleted);
+            numClears = board.numClears;
+            rowsCompleted = board.rowsCompleted;
+        }
+    };
 
-    SDL_RenderPresent(renderer);
-    return result;
-}
+    // held keys repeat on the ticks they're due, presses go on the first tick polled
+    InputHandler::Inputs due;
+    for (;;)
+    {
+        auto tickStart = Clock::now();
+        int numInputs = inputs.poll(simulation.tick, due);
+        for (int i = 0; i < numInputs && !simulation.gameOver; i++)
+        {
+            recorder.record(simulation.tick, toReplayInput(due[i]));
+            if (session)
+            {
+                session->localInput(simulation.tick, due[i]);
+            }
+            simulation.input(due[i]);
+            metrics.add(MetricCounter::INPUTS);
+            countChanges();
+        }
 
-void Board::drawBorders()
-{
-    SDL_Rect outlineRect = { START_X_PIXELS - 1, START_Y_PIXELS - 1, BOARD_WIDTH_PIXELS + 2, BOARD_HEIGHT_PIXELS + 2 };
-    SDL_SetRenderDrawColor(renderer, 0x00, 0xFF, 0x00, 0xFF);
-    SDL_RenderDrawRect(renderer, &outlineRect);
+        if (simulation.tick >= target)
+        {
+            break;
+        }
+        bool running = simulation.step();
+        countChanges();
+        metrics.add(MetricCounter::TICKS);
+        metrics.observe(MetricHistogram::TICK_COST, Clock::now() - tickStart);
+        if (!running)
+        {
+            break;
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// a worker's share of an index range, packed as (begin << 32 | end) so the owner
+// and thieves can both claim indices with a single compare-and-swap
+class alignas(64) StealableRange
+{
+public:
+    void reset(std::uint32_t begin, std::uint32_t end)
+    {
+        bounds.store(pack(begin, end), std::memory_order_relaxed);
+    }
+
+    // owner side, takes the next index from the front
+    bool pop(std::uint32_t& index)
+    {
+        std::uint64_t current = bounds.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            std::uint32_t begin = std::uint32_t(current >> 32);
+            std::uint32_t end = std::uint32_t(current);
+            if (begin >= end)
+            {
+                return false;
+            }
+
+            if (bounds.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel))
+            {
+                index = begin;
+                return true;
+            }
+        }
+    }
+
+    // thief side, takes the back half of what's left
+    bool steal(std::uint32_t& stolenBegin, std::uint32_t& stolenEnd)
+    {
+        std::uint64_t current = bounds.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            std::uint32_t begin = std::uint32_t(current >> 32);
+            std::uint32_t end = std::uint32_t(current);
+            if (begin >= end)
+            {
+                return false;
+            }
+
+            std::uint32_t middle = begin + (end - begin) / 2;
+            if (bounds.compare_exchange_weak(current, pack(begin, middle), std::memory_order_acq_rel))
+            {
+                stolenBegin = middle;
+                stolenEnd = end;
+                return true;
+            }
+        }
+    }
+
+private:
+    std::atomic<std::uint64_t> bounds{ 0 };
+
+    static std::uint64_t pack(std::uint32_t begin, std::uint32_t end)
+    {
+        return (std::uint64_t(begin) << 32) | end;
+    }
+};
+
+// calls body(worker, index) once for every index in [0, count) across numWorkers threads,
+// each starts on an even share and steals from the others once its own runs out
+template <typename Body>
+void parallelFor(int numWorkers, std::uint32_t count, Body body)
+{
+    if (numWorkers < 1)
+    {
+        numWorkers = 1;
+    }
+
+    std::unique_ptr<StealableRange[]> ranges(new StealableRange[numWorkers]);
+    for (int worker = 0; worker < numWorkers; worker++)
+    {
+        std::uint32_t begin = std::uint32_t(std::uint64_t(count) * worker / numWorkers);
+        std::uint32_t end = std::uint32_t(std::uint64_t(count) * (worker + 1) / numWorkers);
+        ranges[worker].reset(begin, end);
+    }
+
+    auto work = [&ranges, &body, numWorkers](int worker)
+    {
+        StealableRange& own = ranges[worker];
+        for (;;)
+        {
+            std::uint32_t index;
+            while (own.pop(index))
+            {
+                body(worker, index);
+            }
+
+            // look for a victim, starting with the next worker so thieves spread out
+            bool stole = false;
+            for (int offset = 1; offset < numWorkers && !stole; offset++)
+            {
+                std::uint32_t begin;
+                std::uint32_t end;
+                if (ranges[(worker + offset) % numWorkers].steal(begin, end))
+                {
+                    own.reset(begin, end);
+                    stole = true;
+                }
+            }
+
+            if (!stole)
+            {
+                // nothing left anywhere, and whatever was stolen is being run by its thief
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numWorkers - 1);
+    for (int worker = 1; worker < numWorkers; worker++)
+    {
+        threads.emplace_back(work, worker);
+    }
+    work(0);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}